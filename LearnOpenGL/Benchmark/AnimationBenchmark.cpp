@@ -0,0 +1,244 @@
+﻿#include "AnimationBenchmark.h"
+#include "../animation.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+    void setIdentity(aiMatrix4x4 &m)
+    {
+        m.a1 = 1; m.a2 = 0; m.a3 = 0; m.a4 = 0;
+        m.b1 = 0; m.b2 = 1; m.b3 = 0; m.b4 = 0;
+        m.c1 = 0; m.c2 = 0; m.c3 = 1; m.c4 = 0;
+        m.d1 = 0; m.d2 = 0; m.d3 = 0; m.d4 = 1;
+    }
+
+    // a tree of boneCount nodes (three children each) and a 2 second animation of all of them, with keys at
+    // uneven times the way exporters write them
+    void buildScene(unsigned int boneCount, aiNode *&root, aiAnimation *&animation, vector<BoneInfo> &bones)
+    {
+        const double ticksPerSecond = 30.0, duration = 60.0;
+        mt19937 random(42);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        vector<aiNode*> nodes(boneCount);
+        for (unsigned int i = 0; i < boneCount; i++)
+        {
+            nodes[i] = new aiNode();
+            nodes[i]->mName = aiString("bone" + to_string(i));
+            setIdentity(nodes[i]->mTransformation);
+            nodes[i]->mTransformation.b4 = 1.0f;
+            nodes[i]->mNumChildren = 0;
+            nodes[i]->mChildren = nullptr;
+            nodes[i]->mParent = i == 0 ? nullptr : nodes[(i - 1) / 3];
+            bones.push_back({ "bone" + to_string(i), glm::mat4(1.0f) });
+        }
+        for (unsigned int i = 0; i < boneCount; i++)
+        {
+            unsigned int first = i * 3 + 1;
+            unsigned int count = first >= boneCount ? 0 : min(3u, boneCount - first);
+            if (count == 0)
+                continue;
+            nodes[i]->mNumChildren = count;
+            nodes[i]->mChildren = new aiNode*[count];
+            for (unsigned int c = 0; c < count; c++)
+                nodes[i]->mChildren[c] = nodes[first + c];
+        }
+        root = nodes[0];
+
+        animation = new aiAnimation();
+        animation->mName = aiString(string("synthetic"));
+        animation->mTicksPerSecond = ticksPerSecond;
+        animation->mDuration = duration;
+        animation->mNumChannels = boneCount;
+        animation->mChannels = new aiNodeAnim*[boneCount];
+        for (unsigned int i = 0; i < boneCount; i++)
+        {
+            aiNodeAnim *channel = new aiNodeAnim();
+            channel->mNodeName = nodes[i]->mName;
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+            float phase = unit(random) * 3.0f;
+            vector<double> times;
+            for (double t = 0.0; t < duration; t += 1.0 + 0.5 * unit(random))
+                times.push_back(t);
+            times.push_back(duration);
+            unsigned int keys = static_cast<unsigned int>(times.size());
+            channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = keys;
+            channel->mPositionKeys = new aiVectorKey[keys];
+            channel->mRotationKeys = new aiQuatKey[keys];
+            channel->mScalingKeys = new aiVectorKey[keys];
+            for (unsigned int k = 0; k < keys; k++)
+            {
+                float t = static_cast<float>(times[k] / ticksPerSecond);
+                float angle = sin(t * 3.0f + phase);
+                channel->mPositionKeys[k].mTime = times[k];
+                channel->mPositionKeys[k].mValue.x = 0.1f * sin(t + phase);
+                channel->mPositionKeys[k].mValue.y = 1.0f;
+                channel->mPositionKeys[k].mValue.z = 0.0f;
+                channel->mRotationKeys[k].mTime = times[k];
+                channel->mRotationKeys[k].mValue.w = cos(angle * 0.5f);
+                channel->mRotationKeys[k].mValue.x = axis.x * sin(angle * 0.5f);
+                channel->mRotationKeys[k].mValue.y = axis.y * sin(angle * 0.5f);
+                channel->mRotationKeys[k].mValue.z = axis.z * sin(angle * 0.5f);
+                channel->mScalingKeys[k].mTime = times[k];
+                channel->mScalingKeys[k].mValue.x = channel->mScalingKeys[k].mValue.y = channel->mScalingKeys[k].mValue.z = 1.0f;
+            }
+            animation->mChannels[i] = channel;
+        }
+    }
+
+    // the way the skeletal animation chapter poses a model: walk the scene graph recursively, look up each node's
+    // channel by name and search its keys (one at a time) for the two around the current tick
+    struct KeySearchAnimator {
+        const aiAnimation *animation;
+        map<string, const aiNodeAnim*> channels;
+        map<string, int> boneIndex;
+        glm::mat4 globalInverse;
+        vector<glm::mat4> boneMatrices;
+
+        template <typename Key>
+        static unsigned int keyIndex(const Key *keys, unsigned int count, double ticks)
+        {
+            for (unsigned int i = 0; i + 1 < count; i++)
+            {
+                if (ticks < keys[i + 1].mTime)
+                    return i;
+            }
+            return count >= 2 ? count - 2 : 0;
+        }
+
+        template <typename Key>
+        static float factor(const Key *keys, unsigned int index, unsigned int count, double ticks)
+        {
+            if (count < 2)
+                return 0.0f;
+            double span = keys[index + 1].mTime - keys[index].mTime;
+            return span > 0.0 ? static_cast<float>(min(max((ticks - keys[index].mTime) / span, 0.0), 1.0)) : 0.0f;
+        }
+
+        void pose(const aiNode *node, const glm::mat4 &parent, double ticks, const vector<BoneInfo> &bones)
+        {
+            string name = node->mName.C_Str();
+            glm::mat4 local = ConvertMatrix(node->mTransformation);
+            auto channel = channels.find(name);
+            if (channel != channels.end())
+            {
+                const aiNodeAnim *c = channel->second;
+                unsigned int p = keyIndex(c->mPositionKeys, c->mNumPositionKeys, ticks);
+                unsigned int r = keyIndex(c->mRotationKeys, c->mNumRotationKeys, ticks);
+                unsigned int s = keyIndex(c->mScalingKeys, c->mNumScalingKeys, ticks);
+                unsigned int p1 = min(p + 1, c->mNumPositionKeys - 1), r1 = min(r + 1, c->mNumRotationKeys - 1), s1 = min(s + 1, c->mNumScalingKeys - 1);
+                const aiVector3D &pa = c->mPositionKeys[p].mValue, &pb = c->mPositionKeys[p1].mValue;
+                const aiVector3D &sa = c->mScalingKeys[s].mValue, &sb = c->mScalingKeys[s1].mValue;
+                const aiQuaternion &ra = c->mRotationKeys[r].mValue, &rb = c->mRotationKeys[r1].mValue;
+                float tp = factor(c->mPositionKeys, p, c->mNumPositionKeys, ticks);
+                float tr = factor(c->mRotationKeys, r, c->mNumRotationKeys, ticks);
+                float ts = factor(c->mScalingKeys, s, c->mNumScalingKeys, ticks);
+                glm::vec3 translation = glm::mix(glm::vec3(pa.x, pa.y, pa.z), glm::vec3(pb.x, pb.y, pb.z), tp);
+                glm::vec3 scale = glm::mix(glm::vec3(sa.x, sa.y, sa.z), glm::vec3(sb.x, sb.y, sb.z), ts);
+                glm::vec4 rotation = SlerpRotation(glm::vec4(ra.x, ra.y, ra.z, ra.w), glm::vec4(rb.x, rb.y, rb.z, rb.w), tr);
+                local = ComposeTransform(translation, rotation, scale);
+            }
+            glm::mat4 global = parent * local;
+            auto bone = boneIndex.find(name);
+            if (bone != boneIndex.end())
+                boneMatrices[bone->second] = globalInverse * global * bones[bone->second].offset;
+            for (unsigned int i = 0; i < node->mNumChildren; i++)
+                pose(node->mChildren[i], global, ticks, bones);
+        }
+    };
+
+    double elapsedMs(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+}
+
+void RunAnimationBenchmark(unsigned int boneCount, unsigned int instanceCount, int repetitions)
+{
+    aiNode *root = nullptr;
+    aiAnimation *animation = nullptr;
+    vector<BoneInfo> bones;
+    buildScene(boneCount, root, animation, bones);
+
+    Skeleton skeleton;
+    skeleton.Build(root, bones);
+    AnimationClip clip;
+    clip.Build(animation, skeleton);
+
+    size_t assimpBytes = 0;
+    KeySearchAnimator reference;
+    reference.animation = animation;
+    reference.globalInverse = glm::inverse(ConvertMatrix(root->mTransformation));
+    reference.boneMatrices.resize(bones.size());
+    for (unsigned int i = 0; i < animation->mNumChannels; i++)
+    {
+        const aiNodeAnim *channel = animation->mChannels[i];
+        reference.channels[channel->mNodeName.C_Str()] = channel;
+        assimpBytes += channel->mNumPositionKeys * sizeof(aiVectorKey) + channel->mNumRotationKeys * sizeof(aiQuatKey) + channel->mNumScalingKeys * sizeof(aiVectorKey);
+    }
+    for (size_t i = 0; i < bones.size(); i++)
+        reference.boneIndex[bones[i].name] = static_cast<int>(i);
+    cout << "BENCHMARK::ANIMATION:: " << boneCount << " bones, " << instanceCount << " instances, clip of " << clip.frameCount
+         << " frames: " << clip.MemoryBytes() / 1024 << " KB resampled, " << assimpBytes / 1024 << " KB of Assimp keys" << endl;
+
+    // every instance at its own point of the clip
+    vector<AnimationInstance> instances(instanceCount, AnimationInstance(skeleton, clip));
+    for (unsigned int i = 0; i < instanceCount; i++)
+        instances[i].time = clip.duration * i / instanceCount;
+    double ticksPerSecond = animation->mTicksPerSecond;
+
+    double referenceBest = -1.0, singleBest = -1.0, pooledBest = -1.0;
+    float maxError = 0.0f;
+    vector<glm::mat4> nodes;
+    for (int r = 0; r < repetitions; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        for (unsigned int i = 0; i < instanceCount; i++)
+            reference.pose(root, glm::mat4(1.0f), instances[i].time * ticksPerSecond, bones);
+        double ms = elapsedMs(start);
+        referenceBest = referenceBest < 0.0 || ms < referenceBest ? ms : referenceBest;
+
+        start = chrono::steady_clock::now();
+        for (AnimationInstance &instance : instances)
+            EvaluateAnimation(instance, nodes);
+        ms = elapsedMs(start);
+        singleBest = singleBest < 0.0 || ms < singleBest ? ms : singleBest;
+
+        // deltaTime 0 keeps the instances where they are
+        start = chrono::steady_clock::now();
+        EvaluateAnimations(instances, 0.0f);
+        ms = elapsedMs(start);
+        pooledBest = pooledBest < 0.0 || ms < pooledBest ? ms : pooledBest;
+    }
+
+    for (unsigned int i = 0; i < instanceCount; i += max(1u, instanceCount / 50))
+    {
+        reference.pose(root, glm::mat4(1.0f), instances[i].time * ticksPerSecond, bones);
+        for (size_t b = 0; b < bones.size(); b++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                for (int row = 0; row < 4; row++)
+                    maxError = max(maxError, fabs(reference.boneMatrices[b][c][row] - instances[i].boneMatrices[b][c][row]));
+            }
+        }
+    }
+
+    cout << "BENCHMARK::ANIMATION:: key search: " << instanceCount / referenceBest << " skeletons/ms" << endl;
+    cout << "BENCHMARK::ANIMATION:: resampled, 1 thread: " << instanceCount / singleBest << " skeletons/ms ("
+         << referenceBest / singleBest << "x)" << endl;
+    cout << "BENCHMARK::ANIMATION:: resampled, " << ThreadPool::Shared().Size() + 1 << " threads: " << instanceCount / pooledBest
+         << " skeletons/ms (" << referenceBest / pooledBest << "x)" << endl;
+    cout << "BENCHMARK::ANIMATION:: max bone matrix difference " << maxError << endl;
+
+    delete animation;
+    delete root;
+}
@@ -0,0 +1,10 @@
+﻿#pragma once
+
+// Micro benchmark for animation.h. It needs no GL context and prints its results to stdout, run it by defining
+// RUN_BENCHMARKS in MainTest.cpp.
+
+// builds a synthetic skeleton of boneCount animated bones and poses instanceCount instances of it, each at its own
+// time: straight from the Assimp channels (searching every channel's keys per node, like the skeletal animation
+// chapter's Animator), from the resampled AnimationClip on one thread, and with EvaluateAnimations on the thread
+// pool. Prints skeletons/ms for each and the largest difference between the bone matrices of the two paths.
+void RunAnimationBenchmark(unsigned int boneCount = 64, unsigned int instanceCount = 1000, int repetitions = 10);
@@ -0,0 +1,100 @@
+﻿#include "DecodeBenchmark.h"
+#include "../file_utils.h"
+#include "../image_decoder.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+namespace
+{
+    // best time of repetitions decodes, in ms. -1 if the decoder turns the file down.
+    double measureDecode(ImageDecoder &decoder, const MappedFile &file, bool flip, int repetitions)
+    {
+        double best = -1.0;
+        for (int r = 0; r < repetitions; r++)
+        {
+            DecodedImage image;
+            auto start = chrono::steady_clock::now();
+            bool ok = decoder.Decode(file.Data(), file.Size(), flip, image);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (!ok)
+                return -1.0;
+            FreeDecodedImage(image);
+            best = best < 0.0 || ms < best ? ms : best;
+        }
+        return best;
+    }
+}
+
+void RunImageDecodeBenchmark(int repetitions)
+{
+    static const char *paths[] = { "container.jpg", "container2.png", "matrix.jpg", "resources/objects/backpack/ao.jpg" };
+    ImageDecoders &decoders = ImageDecoders::Instance();
+    bool flip = decoders.FlipVertically();
+    double stbTotal = 0.0, selectedTotal = 0.0;
+    for (const char *path : paths)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+        {
+            cout << "BENCHMARK::DECODE:: can't find " << path << endl;
+            continue;
+        }
+        Image_File_Format format = DetectImageFileFormat(file.Data(), file.Size());
+        ImageDecoder &stb = decoders.Fallback();
+        ImageDecoder &selected = decoders.For(format);
+
+        DecodedImage reference, decoded;
+        if (!stb.Decode(file.Data(), file.Size(), flip, reference))
+        {
+            cout << "BENCHMARK::DECODE:: stb_image can't decode " << path << endl;
+            continue;
+        }
+        double stbMs = measureDecode(stb, file, flip, repetitions);
+        double selectedMs = &selected == &stb ? stbMs : measureDecode(selected, file, flip, repetitions);
+        double megapixels = double(reference.width) * reference.height / 1e6;
+        cout << "BENCHMARK::DECODE:: " << path << " (" << ImageFileFormatName(format) << ", " << reference.width << "x"
+             << reference.height << "x" << reference.components << ", " << file.Size() / 1024 << " KB) stb_image: " << stbMs
+             << " ms (" << megapixels / stbMs * 1000.0 << " MP/s)";
+        if (&selected == &stb)
+        {
+            cout << ", no other backend built for " << ImageFileFormatName(format) << endl;
+            stbTotal += stbMs;
+            selectedTotal += stbMs;
+            FreeDecodedImage(reference);
+            continue;
+        }
+        if (selectedMs < 0.0 || !selected.Decode(file.Data(), file.Size(), flip, decoded))
+        {
+            cout << ", " << selected.Name() << " turned it down (stb_image decodes it)" << endl;
+            stbTotal += stbMs;
+            selectedTotal += stbMs;
+            FreeDecodedImage(reference);
+            continue;
+        }
+        stbTotal += stbMs;
+        selectedTotal += selectedMs;
+        cout << ", " << selected.Name() << ": " << selectedMs << " ms (" << megapixels / selectedMs * 1000.0 << " MP/s), speedup "
+             << stbMs / selectedMs << "x";
+
+        // JPEG decoders may round their IDCT differently, PNG has to match exactly
+        if (decoded.width != reference.width || decoded.height != reference.height || decoded.components != reference.components)
+            cout << ", MISMATCHED size " << decoded.width << "x" << decoded.height << "x" << decoded.components << endl;
+        else
+        {
+            int maxError = 0;
+            size_t count = size_t(reference.width) * reference.height * reference.components;
+            for (size_t i = 0; i < count; i++)
+                maxError = max(maxError, abs(int(reference.data[i]) - int(decoded.data[i])));
+            cout << ", max pixel difference " << maxError << endl;
+        }
+        FreeDecodedImage(reference);
+        FreeDecodedImage(decoded);
+    }
+    if (selectedTotal > 0.0)
+        cout << "BENCHMARK::DECODE:: all images: stb_image " << stbTotal << " ms, selected backends " << selectedTotal
+             << " ms, speedup " << stbTotal / selectedTotal << "x" << endl;
+}
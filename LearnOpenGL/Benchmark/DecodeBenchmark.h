@@ -0,0 +1,9 @@
+﻿#pragma once
+
+// Micro benchmark for image_decoder.h. It needs no GL context and prints its results to stdout, run it by defining
+// RUN_BENCHMARKS in MainTest.cpp.
+
+// decodes the sample images (container.jpg, container2.png, matrix.jpg and the backpack's ao.jpg) out of memory
+// with stb_image and with the backend ImageDecoders picks for their format (libjpeg-turbo / libspng when built with
+// IMAGE_DECODER_TURBOJPEG / IMAGE_DECODER_SPNG), prints the best times and the largest pixel difference.
+void RunImageDecodeBenchmark(int repetitions = 10);
@@ -0,0 +1,294 @@
+﻿#include "ImportBenchmark.h"
+#include "../model.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+    // the conversion as it was before: one vertex at a time, attribute checks per vertex, growing vectors
+    void legacyImport(const aiMesh *mesh, vector<Vertex> &outVertices, vector<unsigned int> &outIndices)
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex vertex;
+            SetVertexBoneDataToDefault(vertex);
+            glm::vec3 vector;
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            if (mesh->HasNormals())
+            {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+            if (mesh->mTextureCoords[0])
+            {
+                glm::vec2 vec;
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            vertices.push_back(vertex);
+        }
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            aiFace face = mesh->mFaces[i];
+            for (unsigned int j = 0; j < face.mNumIndices; j++)
+                indices.push_back(face.mIndices[j]);
+        }
+        // the old code copied the vectors once more on their way into the Mesh
+        outVertices = vertices;
+        outIndices = indices;
+    }
+
+    void bulkImport(const aiMesh *mesh, vector<Vertex> &outVertices, vector<unsigned int> &outIndices)
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        ImportVertices(mesh, vertices);
+        ImportIndices(mesh, indices);
+        outVertices = std::move(vertices);
+        outIndices = std::move(indices);
+    }
+
+    // best time of repetitions imports, optionally evicting the file from the page cache before each one
+    double measureFile(const char *name, const string &path, bool mapped, bool cold, int repetitions)
+    {
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        double best = -1.0;
+        for (int r = 0; r < repetitions; r++)
+        {
+            if (cold && !EvictFromPageCache(path))
+                cold = false;
+            Assimp::Importer importer;
+            if (mapped)
+                importer.SetIOHandler(new AssetIOSystem());
+            auto start = chrono::steady_clock::now();
+            const aiScene *scene = importer.ReadFile(path, importFlags);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (!scene)
+            {
+                cout << "BENCHMARK::IMPORT:: " << importer.GetErrorString() << endl;
+                return 0.0;
+            }
+            if (best < 0.0 || ms < best)
+                best = ms;
+        }
+        cout << "BENCHMARK::IMPORT:: " << name << (cold ? " cold: " : " warm: ") << best << " ms" << endl;
+        return best;
+    }
+
+    // unindexed triangles of all meshes with the same material, in file order
+    typedef map<string, vector<Vertex> > TrianglesByMaterial;
+
+    void appendTriangles(const vector<Vertex> &vertices, const vector<unsigned int> &indices, vector<Vertex> &out)
+    {
+        for (unsigned int index : indices)
+            out.push_back(vertices[index]);
+    }
+
+    // compares triangle by triangle, allowing the corners of a triangle to be rotated
+    void compareTriangles(const TrianglesByMaterial &expected, const TrianglesByMaterial &actual)
+    {
+        const float epsilon = 1e-5f;
+        size_t triangles = 0, mismatched = 0;
+        float positionError = 0.0f, texCoordError = 0.0f, normalError = 0.0f, tangentError = 0.0f;
+        for (const auto &item : expected)
+        {
+            auto found = actual.find(item.first);
+            if (found == actual.end() || found->second.size() != item.second.size())
+            {
+                cout << "BENCHMARK::IMPORT:: material " << item.first << ": " << item.second.size() / 3 << " triangles from Assimp, "
+                    << (found == actual.end() ? 0 : found->second.size() / 3) << " from the OBJ loader" << endl;
+                mismatched += item.second.size() / 3;
+                continue;
+            }
+            const vector<Vertex> &a = item.second, &b = found->second;
+            for (size_t t = 0; t < a.size(); t += 3, triangles++)
+            {
+                int rotation = -1;
+                for (int r = 0; r < 3 && rotation < 0; r++)
+                {
+                    bool same = true;
+                    for (int k = 0; k < 3; k++)
+                        same = same && glm::length(a[t + k].Position - b[t + (k + r) % 3].Position) <= epsilon;
+                    if (same)
+                        rotation = r;
+                }
+                if (rotation < 0)
+                {
+                    mismatched++;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const Vertex &va = a[t + k], &vb = b[t + (k + rotation) % 3];
+                    positionError = max(positionError, glm::length(va.Position - vb.Position));
+                    texCoordError = max(texCoordError, glm::length(va.TexCoords - vb.TexCoords));
+                    normalError = max(normalError, glm::length(va.Normal - vb.Normal));
+                    tangentError = max(tangentError, glm::length(va.Tangent - vb.Tangent));
+                }
+            }
+        }
+        cout << "BENCHMARK::IMPORT:: " << triangles << " triangles compared, " << mismatched << " mismatched, max error position "
+            << positionError << ", uv " << texCoordError << ", normal " << normalError << ", tangent " << tangentError << endl;
+    }
+
+    template <typename Import>
+    double measure(const char *name, const aiMesh *mesh, int repetitions, Import import)
+    {
+        double best = 0.0;
+        for (int r = 0; r < repetitions; r++)
+        {
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            auto start = chrono::steady_clock::now();
+            import(mesh, vertices, indices);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            double rate = mesh->mNumVertices / seconds;
+            if (rate > best)
+                best = rate;
+        }
+        cout << "BENCHMARK::IMPORT:: " << name << ": " << best / 1e6 << " M vertices/sec" << endl;
+        return best;
+    }
+}
+
+void RunVertexImportBenchmark(unsigned int vertexCount, int repetitions)
+{
+    // a triangle strip like grid of vertices with every attribute processMesh reads
+    aiMesh mesh;
+    mesh.mNumVertices = vertexCount;
+    mesh.mVertices = new aiVector3D[vertexCount];
+    mesh.mNormals = new aiVector3D[vertexCount];
+    mesh.mTangents = new aiVector3D[vertexCount];
+    mesh.mBitangents = new aiVector3D[vertexCount];
+    for (unsigned int t = 0; t < AI_MAX_NUMBER_OF_TEXTURECOORDS; t++)
+        mesh.mTextureCoords[t] = nullptr;
+    mesh.mTextureCoords[0] = new aiVector3D[vertexCount];
+    for (unsigned int i = 0; i < vertexCount; i++)
+    {
+        float x = float(i % 1024), y = float(i / 1024);
+        mesh.mVertices[i] = aiVector3D(x, y, 0.0f);
+        mesh.mNormals[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+        mesh.mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+        mesh.mBitangents[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+        mesh.mTextureCoords[0][i] = aiVector3D(x / 1024.0f, y / 1024.0f, 0.0f);
+    }
+    mesh.mNumFaces = vertexCount > 2 ? vertexCount - 2 : 0;
+    mesh.mFaces = new aiFace[mesh.mNumFaces];
+    for (unsigned int f = 0; f < mesh.mNumFaces; f++)
+    {
+        mesh.mFaces[f].mNumIndices = 3;
+        mesh.mFaces[f].mIndices = new unsigned int[3] { f, f + 1, f + 2 };
+    }
+    // aiMesh frees all of the arrays above in its destructor
+
+    double legacy = measure("per vertex push_back", &mesh, repetitions, legacyImport);
+    double bulk = measure("bulk ImportVertices ", &mesh, repetitions, bulkImport);
+    cout << "BENCHMARK::IMPORT:: " << vertexCount << " vertices, speedup " << bulk / legacy << "x" << endl;
+}
+
+void RunFileImportBenchmark(const char *path, int repetitions)
+{
+    FileStamp stamp;
+    if (!GetFileStamp(path, stamp))
+    {
+        cout << "BENCHMARK::IMPORT:: can't find " << path << endl;
+        return;
+    }
+    cout << "BENCHMARK::IMPORT:: " << path << " (" << stamp.size / 1024 << " KB)" << endl;
+    // cold runs first, the warm ones then find everything in the page cache
+    double stdioCold = measureFile("stdio ", path, false, true, repetitions);
+    double mappedCold = measureFile("mapped", path, true, true, repetitions);
+    double stdioWarm = measureFile("stdio ", path, false, false, repetitions);
+    double mappedWarm = measureFile("mapped", path, true, false, repetitions);
+    if (mappedCold > 0.0 && mappedWarm > 0.0)
+        cout << "BENCHMARK::IMPORT:: mapped speedup cold " << stdioCold / mappedCold << "x, warm " << stdioWarm / mappedWarm << "x" << endl;
+}
+
+void RunObjImportBenchmark(const char *path, int repetitions)
+{
+    const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+    TrianglesByMaterial assimpTriangles, objTriangles;
+    size_t assimpVertices = 0, objVertices = 0;
+
+    double assimpBest = -1.0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        Assimp::Importer importer;
+        importer.SetIOHandler(new AssetIOSystem());
+        const aiScene *scene = importer.ReadFile(path, importFlags);
+        if (!scene)
+        {
+            cout << "BENCHMARK::IMPORT:: " << importer.GetErrorString() << endl;
+            return;
+        }
+        vector<vector<Vertex> > vertices(scene->mNumMeshes);
+        vector<vector<unsigned int> > indices(scene->mNumMeshes);
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+        {
+            ImportVertices(scene->mMeshes[i], vertices[i]);
+            ImportIndices(scene->mMeshes[i], indices[i]);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (assimpBest < 0.0 || ms < assimpBest)
+            assimpBest = ms;
+        if (r == 0)
+        {
+            for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+            {
+                string material = scene->mMaterials[scene->mMeshes[i]->mMaterialIndex]->GetName().C_Str();
+                appendTriangles(vertices[i], indices[i], assimpTriangles[material]);
+                assimpVertices += vertices[i].size();
+            }
+        }
+    }
+
+    double objBest = -1.0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        ObjModel model;
+        if (!LoadObj(path, model))
+            return;
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (objBest < 0.0 || ms < objBest)
+            objBest = ms;
+        if (r == 0)
+        {
+            for (const ObjMesh &mesh : model.meshes)
+            {
+                // Assimp's OBJ importer calls faces without a material "DefaultMaterial"
+                string material = mesh.material >= 0 ? model.materials[mesh.material].name : "DefaultMaterial";
+                appendTriangles(mesh.vertices, mesh.indices, objTriangles[material]);
+                objVertices += mesh.vertices.size();
+            }
+        }
+    }
+
+    cout << "BENCHMARK::IMPORT:: " << path << " Assimp: " << assimpBest << " ms (" << assimpVertices << " vertices), OBJ loader: "
+        << objBest << " ms (" << objVertices << " vertices), " << assimpBest / objBest << "x" << endl;
+    compareTriangles(assimpTriangles, objTriangles);
+}
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+// Micro benchmarks for the model import path. They need no GL context and print their results to stdout,
+// run them by defining RUN_BENCHMARKS in MainTest.cpp.
+
+// converts a synthetic Assimp mesh of vertexCount vertices with the per vertex push_back conversion
+// Model::processMesh used to do and with ImportVertices/ImportIndices, and prints vertices/sec for both.
+void RunVertexImportBenchmark(unsigned int vertexCount = 1 << 20, int repetitions = 10);
+
+// imports the model at path with Assimp's default stdio file system and with the memory mapped AssetIOSystem,
+// each with a cold page cache (the file is evicted before every run) and a warm one, and prints the best times.
+void RunFileImportBenchmark(const char *path = "resources/objects/backpack/backpack.obj", int repetitions = 5);
+
+// imports an .obj with Assimp (plus the vertex conversion Model does) and with the native loader in obj_loader.h,
+// prints the best times and checks that both produce the same triangles per material.
+void RunObjImportBenchmark(const char *path = "resources/objects/backpack/backpack.obj", int repetitions = 5);
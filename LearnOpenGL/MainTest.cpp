@@ -9,7 +9,14 @@
 
 #include "camera.h"
 #include "model.h"
+#include "hot_reload.h"
 #include "Light/LightCombine.h"
+#include "Benchmark/ImportBenchmark.h"
+#include "Benchmark/AnimationBenchmark.h"
+#include "Benchmark/DecodeBenchmark.h"
+
+// uncomment to run the CPU micro benchmarks (Benchmark/) before the window opens
+// #define RUN_BENCHMARKS
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -32,6 +39,14 @@ float lastFrame = 0.0f;
 
 int main()
 {
+#ifdef RUN_BENCHMARKS
+    RunVertexImportBenchmark();
+    RunFileImportBenchmark();
+    RunObjImportBenchmark();
+    RunAnimationBenchmark();
+    RunImageDecodeBenchmark();
+#endif
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -68,79 +83,106 @@ int main()
         return -1;
     }
 
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    stbi_set_flip_vertically_on_load(true);
+    // tell the image decoders to flip loaded texture's on the y-axis (before loading model).
+    ImageDecoders::Instance().SetFlipVertically(true);
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile shaders
-    // -------------------------
-    Shader ourShader("lighting.vert", "lighting.frag");
-    Shader lightCubeShader("light_cube.vert", "light_cube.frag");
-
-    // load models
-    // -----------
-    Model ourModel("resources/objects/backpack/backpack.obj");
-
-    // Light
-    DirectionalLight dirLight(ourShader, lightCubeShader, camera);
-    PointLight pointLight(ourShader, lightCubeShader, camera);
-    SpotLight spotLight(ourShader, lightCubeShader, camera);
-    
-    // draw in wireframe
-    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // the shaders, models and lights delete their GL objects when destroyed, so they live in a scope that ends
+    // while the context still exists
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
-        // render
-        // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
-
-        // be sure to activate shader when setting uniforms/drawing objects
-        ourShader.setVec3("viewPos", camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // directional light
-        dirLight.Draw(projection);
-        pointLight.Draw(projection);
-        spotLight.Draw(projection);
-
-        ourShader.use();
-        // render the loaded model
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        ourModel.Draw(ourShader);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // build and compile shaders
+        // -------------------------
+        Shader ourShader("lighting.vert", "lighting.frag");
+        Shader lightCubeShader("light_cube.vert", "light_cube.frag");
+
+        // load models
+        // -----------
+        // serve resources/ out of a pack built with Tools/PackBuilder.cpp if there is one, loose files otherwise
+        AssetFileSystem::Instance().Mount("resources.pack", "resources");
+        // streamed in on background threads, the render loop starts right away
+        ModelLoadOptions modelOptions;
+        modelOptions.asyncLoad = true;
+        // bind all material textures once per draw instead of per mesh. Needs lighting_array.frag whenever
+        // ourModel.TextureArrays() isn't empty, and lighting.frag while it loads or if the arrays can't be built.
+        //modelOptions.textureArrays = true;
+        Model ourModel("resources/objects/backpack/backpack.obj", modelOptions);
+
+        // rebuild the shaders, the model and its textures when their files are edited
+        HotReload hotReload;
+        hotReload.WatchShader(ourShader);
+        hotReload.WatchShader(lightCubeShader);
+        hotReload.WatchModel(ourModel);
+
+        // Light
+        DirectionalLight dirLight(ourShader, lightCubeShader, camera);
+        PointLight pointLight(ourShader, lightCubeShader, camera);
+        SpotLight spotLight(ourShader, lightCubeShader, camera);
+    
+        // draw in wireframe
+        //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            // per-frame time logic
+            // --------------------
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // input
+            // -----
+            processInput(window);
+
+            // reload what changed on disk, then upload whatever parts of the model finished loading since the last frame
+            hotReload.Update();
+            ourModel.Update();
+
+            // render
+            // ------
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // don't forget to enable shader before setting uniforms
+            ourShader.use();
+
+            // be sure to activate shader when setting uniforms/drawing objects
+            ourShader.setVec3("viewPos", camera.Position);
+            ourShader.setFloat("material.shininess", 32.0f);
+
+            // view/projection transformations
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            glm::mat4 view = camera.GetViewMatrix();
+            ourShader.setMat4("projection", projection);
+            ourShader.setMat4("view", view);
+
+            // directional light
+            dirLight.Draw(projection);
+            pointLight.Draw(projection);
+            spotLight.Draw(projection);
+
+            ourShader.use();
+            // render the loaded model
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
+            model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
+            ourShader.setMat4("model", model);
+            ourModel.Draw(ourShader, camera, model, (float)SCR_HEIGHT);
+
+            // raise or drop texture mip levels by what this frame's draws reported (models loaded with streamTextures)
+            TextureStreamer::Instance().Update();
+            // evict the models that weren't drawn lately if the GPU memory is over budget, they load again when drawn
+            GpuResourceManager::Instance().Update();
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -0,0 +1,102 @@
+﻿// Packs asset directories into a .pack archive (see asset_archive.h) that AssetFileSystem can mount:
+//   PackBuilder resources.pack resources
+// stores every file below resources/ under its path relative to that directory, so the archive is mounted with
+//   AssetFileSystem::Instance().Mount("resources.pack", "resources");
+// Mesh caches and temporary files are left out. Built as its own console program, like TextureCooker.
+#include "../asset_archive.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+namespace
+{
+    bool endsWith(const string &text, const string &suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // appends all files below directory, named relative to the directory the walk started in
+    void collectFiles(const string &directory, const string &relative, vector<AssetArchiveSource> &files)
+    {
+        vector<string> children, subdirectories;
+#ifdef _WIN32
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+        if (search == INVALID_HANDLE_VALUE)
+            return;
+        do
+        {
+            string name = found.cFileName;
+            if (name == "." || name == "..")
+                continue;
+            if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                subdirectories.push_back(name);
+            else
+                children.push_back(name);
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (!dir)
+            return;
+        while (dirent *item = readdir(dir))
+        {
+            string name = item->d_name;
+            if (name == "." || name == "..")
+                continue;
+            struct stat info;
+            if (stat((directory + "/" + name).c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode))
+                subdirectories.push_back(name);
+            else if (S_ISREG(info.st_mode))
+                children.push_back(name);
+        }
+        closedir(dir);
+#endif
+        for (const string &name : children)
+        {
+            if (endsWith(name, ".meshcache") || endsWith(name, ".tmp"))
+                continue;
+            files.push_back({ relative.empty() ? name : relative + "/" + name, directory + "/" + name });
+        }
+        for (const string &name : subdirectories)
+            collectFiles(directory + "/" + name, relative.empty() ? name : relative + "/" + name, files);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        cout << "usage: PackBuilder output.pack directory..." << endl;
+        return 1;
+    }
+
+    vector<AssetArchiveSource> files;
+    for (int i = 2; i < argc; i++)
+        collectFiles(argv[i], "", files);
+    if (!AssetArchive::Write(argv[1], files))
+    {
+        cout << "TOOLS::PACK:: failed to write " << argv[1] << endl;
+        return 1;
+    }
+
+    AssetArchive archive;
+    if (!archive.Open(argv[1]))
+    {
+        cout << "TOOLS::PACK:: " << argv[1] << " was written but can't be read back" << endl;
+        return 1;
+    }
+    cout << "TOOLS::PACK:: " << argv[1] << " " << archive.Count() << " files, " << archive.Stamp().size / 1024 << " KB" << endl;
+    return 0;
+}
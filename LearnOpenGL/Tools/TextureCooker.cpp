@@ -0,0 +1,112 @@
+﻿// Offline texture cooker: compresses images into the .dds files the TextureLoader picks up when
+// ModelLoadOptions::compressTextures is set, so the first run of the viewer doesn't pay for the encoding.
+// Built as its own console program (it is not part of the LearnOpenGL target and needs no GL context):
+//   TextureCooker [--normal] [--bc1|--bc3|--bc5|--bc7] [--srgb] [--force] image...
+// Every image is written to image.dds. Color images default to BC7, --normal selects BC5. --srgb filters the mips
+// in linear light, matching a model loaded with gammaCorrection. Cooked files that are already up to date are
+// skipped unless --force is given.
+// stb_image is the decoders' fallback
+#define STB_IMAGE_IMPLEMENTATION
+#include "../image_decoder.h"
+
+#include "../dds_file.h"
+#include "../file_utils.h"
+#include "../texture_compress.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+    bool cookImage(const string &filename, Texture_Usage usage, Texture_Codec forcedCodec, bool srgb, bool force)
+    {
+        FileStamp source;
+        if (!GetFileStamp(filename, source))
+        {
+            cout << "TOOLS::COOK:: can't open " << filename << endl;
+            return false;
+        }
+        string cookedPath = filename + ".dds";
+        TextureLevels existing;
+        if (!force && ReadDDS(cookedPath, existing, &source) && (forcedCodec == CODEC_NONE || existing.codec == forcedCodec) &&
+            existing.srgbMips == srgb)
+        {
+            cout << "TOOLS::COOK:: " << cookedPath << " is up to date" << endl;
+            return true;
+        }
+
+        auto start = chrono::steady_clock::now();
+        MappedFile file;
+        DecodedImage decoded;
+        if (!file.Open(filename, true) || !ImageDecoders::Instance().Decode(file.Data(), file.Size(), decoded))
+        {
+            cout << "TOOLS::COOK:: failed to decode " << filename << endl;
+            return false;
+        }
+        unsigned char *pixels = decoded.data;
+        int width = decoded.width, height = decoded.height, components = decoded.components;
+        Texture_Codec codec = forcedCodec;
+        if (codec == CODEC_NONE)
+            codec = ChooseCodec(usage, ImageHasTransparency(pixels, width, height, components), true, true);
+
+        TextureLevels image;
+        bool compressed = CompressImage(pixels, width, height, components, codec, image, srgb);
+        FreeDecodedImage(decoded);
+        if (!compressed || !WriteDDS(cookedPath, image, source))
+        {
+            cout << "TOOLS::COOK:: failed to write " << cookedPath << endl;
+            return false;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size_t rawSize = size_t(width) * height * components * 4 / 3;
+        cout << "TOOLS::COOK:: " << cookedPath << " " << width << "x" << height << " " << CodecName(codec) << ", "
+            << image.mips.size() << " levels, " << image.data.size() / 1024 << " KB (" << rawSize / 1024
+            << " KB uncompressed) in " << ms << " ms" << endl;
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Texture_Usage usage = TEXTURE_USAGE_COLOR;
+    Texture_Codec codec = CODEC_NONE;
+    bool srgb = false;
+    bool force = false;
+    vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--normal") == 0)
+            usage = TEXTURE_USAGE_NORMAL;
+        else if (strcmp(argv[i], "--bc1") == 0)
+            codec = CODEC_BC1;
+        else if (strcmp(argv[i], "--bc3") == 0)
+            codec = CODEC_BC3;
+        else if (strcmp(argv[i], "--bc5") == 0)
+            codec = CODEC_BC5;
+        else if (strcmp(argv[i], "--bc7") == 0)
+            codec = CODEC_BC7;
+        else if (strcmp(argv[i], "--srgb") == 0)
+            srgb = true;
+        else if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty())
+    {
+        cout << "usage: TextureCooker [--normal] [--bc1|--bc3|--bc5|--bc7] [--srgb] [--force] image..." << endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (const string &file : files)
+    {
+        if (!cookImage(file, usage, codec, srgb && usage == TEXTURE_USAGE_COLOR, force))
+            failed++;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "asset_io_system.h"
+#include "model.h"
+#include "skinning.h"
+#include "thread_pool.h"
+using namespace std;
+
+// Skeletal animation: Assimp's animation channels resampled into flat keyframe tracks, and an evaluator that turns
+// many animated instances into bone matrices at once, spread over ThreadPool::Shared().
+//   Skeleton skeleton;
+//   vector<AnimationClip> clips;
+//   LoadAnimations(character, skeleton, clips);       // character: a skinned Model
+//   vector<AnimationInstance> crowd(100, AnimationInstance(skeleton, clips[0]));
+//   EvaluateAnimations(crowd, deltaTime);             // once per frame
+//   palette.Begin();
+//   for (AnimationInstance &instance : crowd)
+//       int base = palette.Add(instance.boneMatrices.data(), instance.boneMatrices.size());
+// A clip stores every track at the same uniform frame times, so sampling it is an index computation instead of a
+// search through each channel's own keys, and the tracks of one frame lie next to each other in memory.
+
+// a unit quaternion in 48 bits ("smallest three"): the largest component is dropped and made positive (q and -q
+// are the same rotation), the other three are stored with 15 bits each. The index of the dropped one takes the
+// top bits of the first two words.
+struct QuantizedQuat {
+    uint16_t bits[3];
+};
+
+// the components that aren't the largest lie within +-1/sqrt(2)
+#define QUANTIZED_QUAT_RANGE 0.70710678f
+
+// rotations are x, y, z, w in a vec4
+inline QuantizedQuat QuantizeRotation(glm::vec4 q)
+{
+    float length = sqrt(glm::dot(q, q));
+    q = length > 0.0f ? q * (1.0f / length) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+    {
+        if (fabs(q[i]) > fabs(q[largest]))
+            largest = i;
+    }
+    if (q[largest] < 0.0f)
+        q = q * -1.0f;
+    QuantizedQuat packed;
+    int slot = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+        float v = min(max(q[i] / QUANTIZED_QUAT_RANGE, -1.0f), 1.0f);
+        packed.bits[slot++] = static_cast<uint16_t>(lround((v * 0.5f + 0.5f) * 32767.0f));
+    }
+    packed.bits[0] |= static_cast<uint16_t>((largest & 1) << 15);
+    packed.bits[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+    return packed;
+}
+
+inline glm::vec4 DequantizeRotation(const QuantizedQuat &packed)
+{
+    int largest = (packed.bits[0] >> 15) | ((packed.bits[1] >> 15) << 1);
+    glm::vec4 q;
+    float sum = 0.0f;
+    int slot = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+        float v = ((packed.bits[slot++] & 0x7fff) * (2.0f / 32767.0f) - 1.0f) * QUANTIZED_QUAT_RANGE;
+        q[i] = v;
+        sum += v * v;
+    }
+    q[largest] = sqrt(max(0.0f, 1.0f - sum));
+    return q;
+}
+
+// the matrix that scales, then rotates (a unit quaternion) and then translates, written out directly rather than
+// multiplying three mat4s together
+inline glm::mat4 ComposeTransform(const glm::vec3 &translation, const glm::vec4 &rotation, const glm::vec3 &scale)
+{
+    float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+    glm::mat4 m;
+    m[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy + wz) * scale.x, 2.0f * (xz - wy) * scale.x, 0.0f);
+    m[1] = glm::vec4(2.0f * (xy - wz) * scale.y, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz + wx) * scale.y, 0.0f);
+    m[2] = glm::vec4(2.0f * (xz + wy) * scale.z, 2.0f * (yz - wx) * scale.z, (1.0f - 2.0f * (xx + yy)) * scale.z, 0.0f);
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+}
+
+// normalized linear interpolation along the shorter arc, close enough to slerp for neighbouring frames
+inline glm::vec4 NlerpRotation(const glm::vec4 &a, glm::vec4 b, float t)
+{
+    if (glm::dot(a, b) < 0.0f)
+        b = b * -1.0f;
+    glm::vec4 q = a + (b - a) * t;
+    return q * (1.0f / sqrt(glm::dot(q, q)));
+}
+
+inline glm::vec4 SlerpRotation(const glm::vec4 &a, glm::vec4 b, float t)
+{
+    float cosAngle = glm::dot(a, b);
+    if (cosAngle < 0.0f)
+    {
+        b = b * -1.0f;
+        cosAngle = -cosAngle;
+    }
+    if (cosAngle > 0.9995f)
+        return NlerpRotation(a, b, t);
+    float angle = acos(cosAngle);
+    float sinAngle = sin(angle);
+    return a * (sin((1.0f - t) * angle) / sinAngle) + b * (sin(t * angle) / sinAngle);
+}
+
+// The node hierarchy the bones of a model hang in, flattened so every parent comes before its children. Only the
+// bones' nodes and their ancestors are kept: the rest of the scene graph doesn't move any vertex.
+class Skeleton
+{
+public:
+    vector<string> names;
+    vector<int> parents;			// -1 for the root
+    vector<glm::mat4> bindLocals;	// relative to the parent, for nodes no track animates
+    vector<int> boneNodes;			// per bone of the model: its node, -1 if the hierarchy has no node of its name
+    vector<glm::mat4> boneOffsets;	// per bone: BoneInfo::offset
+    glm::mat4 globalInverse = glm::mat4(1.0f);
+
+    void Build(const aiNode *root, const vector<BoneInfo> &bones)
+    {
+        names.clear();
+        parents.clear();
+        bindLocals.clear();
+        nodeIndex.clear();
+        if (root == nullptr)
+            return;
+        globalInverse = glm::inverse(ConvertMatrix(root->mTransformation));
+
+        // pre-order walk, parents first
+        vector<string> allNames;
+        vector<int> allParents;
+        vector<glm::mat4> allLocals;
+        vector<pair<const aiNode*, int> > stack = { { root, -1 } };
+        while (!stack.empty())
+        {
+            const aiNode *node = stack.back().first;
+            int parent = stack.back().second;
+            stack.pop_back();
+            int index = static_cast<int>(allNames.size());
+            allNames.push_back(node->mName.C_Str());
+            allParents.push_back(parent);
+            allLocals.push_back(ConvertMatrix(node->mTransformation));
+            for (unsigned int i = node->mNumChildren; i-- > 0; )
+                stack.push_back({ node->mChildren[i], index });
+        }
+
+        unordered_map<string, int> allIndex;
+        for (size_t i = 0; i < allNames.size(); i++)
+            allIndex.emplace(allNames[i], static_cast<int>(i));
+        vector<bool> needed(allNames.size(), false);
+        for (const BoneInfo &bone : bones)
+        {
+            auto found = allIndex.find(bone.name);
+            for (int node = found == allIndex.end() ? -1 : found->second; node >= 0 && !needed[node]; node = allParents[node])
+                needed[node] = true;
+        }
+        vector<int> remap(allNames.size(), -1);
+        for (size_t i = 0; i < allNames.size(); i++)
+        {
+            if (!needed[i])
+                continue;
+            remap[i] = static_cast<int>(names.size());
+            nodeIndex[allNames[i]] = remap[i];
+            names.push_back(allNames[i]);
+            parents.push_back(allParents[i] < 0 ? -1 : remap[allParents[i]]);
+            bindLocals.push_back(allLocals[i]);
+        }
+
+        boneNodes.clear();
+        boneOffsets.clear();
+        for (const BoneInfo &bone : bones)
+        {
+            boneNodes.push_back(FindNode(bone.name));
+            boneOffsets.push_back(bone.offset);
+            if (boneNodes.back() < 0)
+                cout << "WARNING::ANIMATION:: bone " << bone.name << " has no node in the hierarchy" << endl;
+        }
+    }
+
+    // -1 if the skeleton has no node of that name
+    int FindNode(const string &name) const
+    {
+        auto found = nodeIndex.find(name);
+        return found == nodeIndex.end() ? -1 : found->second;
+    }
+
+    size_t NodeCount() const { return names.size(); }
+    size_t BoneCount() const { return boneNodes.size(); }
+
+private:
+    unordered_map<string, int> nodeIndex;
+};
+
+// One animation resampled at uniform frame times. Each component is stored frame major in its own array
+// (translations[frame * TrackCount() + track]), so sampling a frame walks three arrays front to back. Rotations
+// are quantized to 6 bytes, a track frame takes 30 bytes instead of the 44 of full floats.
+class AnimationClip
+{
+public:
+    string name;
+    float duration = 0.0f;		// seconds
+    unsigned int frameCount = 0;
+
+    // resamples the channels of animation that drive nodes of skeleton at sampleRate frames per second (rounded
+    // up so the last frame falls on the end of the clip). Channels of nodes the skeleton dropped are skipped.
+    bool Build(const aiAnimation *animation, const Skeleton &skeleton, float sampleRate = 30.0f)
+    {
+        name = animation->mName.C_Str();
+        trackNodes.clear();
+        translations.clear();
+        rotations.clear();
+        scales.clear();
+
+        // Assimp leaves the tick rate 0 when the file doesn't say, 25 is its own fallback
+        double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+        duration = static_cast<float>(animation->mDuration / ticksPerSecond);
+        frameCount = duration > 0.0f ? static_cast<unsigned int>(ceil(duration * sampleRate)) + 1 : 1;
+        frameTime = frameCount > 1 ? duration / (frameCount - 1) : 0.0f;
+
+        vector<const aiNodeAnim*> channels;
+        for (unsigned int i = 0; i < animation->mNumChannels; i++)
+        {
+            const aiNodeAnim *channel = animation->mChannels[i];
+            int node = skeleton.FindNode(channel->mNodeName.C_Str());
+            if (node < 0 || find(trackNodes.begin(), trackNodes.end(), node) != trackNodes.end())
+                continue;
+            trackNodes.push_back(node);
+            channels.push_back(channel);
+        }
+        if (trackNodes.empty())
+            return false;
+
+        size_t tracks = trackNodes.size();
+        translations.resize(frameCount * tracks);
+        rotations.resize(frameCount * tracks);
+        scales.resize(frameCount * tracks);
+        for (size_t track = 0; track < tracks; track++)
+        {
+            const aiNodeAnim *channel = channels[track];
+            const glm::mat4 &bind = skeleton.bindLocals[trackNodes[track]];
+            glm::vec3 bindTranslation(bind[3]);
+            glm::vec4 previous(0.0f, 0.0f, 0.0f, 1.0f);
+            for (unsigned int frame = 0; frame < frameCount; frame++)
+            {
+                double ticks = min(frame * frameTime, duration) * ticksPerSecond;
+                size_t slot = frame * tracks + track;
+                translations[slot] = channel->mNumPositionKeys > 0 ? sampleKeys(channel->mPositionKeys, channel->mNumPositionKeys, ticks) : bindTranslation;
+                scales[slot] = channel->mNumScalingKeys > 0 ? sampleKeys(channel->mScalingKeys, channel->mNumScalingKeys, ticks) : glm::vec3(1.0f);
+                glm::vec4 rotation = channel->mNumRotationKeys > 0 ? sampleKeys(channel->mRotationKeys, channel->mNumRotationKeys, ticks) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+                // keep neighbouring frames in the same hemisphere
+                if (glm::dot(rotation, previous) < 0.0f)
+                    rotation = rotation * -1.0f;
+                previous = rotation;
+                rotations[slot] = QuantizeRotation(rotation);
+            }
+        }
+        return true;
+    }
+
+    size_t TrackCount() const { return trackNodes.size(); }
+    const vector<int>& TrackNodes() const { return trackNodes; }
+    size_t MemoryBytes() const
+    {
+        return trackNodes.size() * sizeof(int) + translations.size() * sizeof(glm::vec3) +
+            rotations.size() * sizeof(QuantizedQuat) + scales.size() * sizeof(glm::vec3);
+    }
+
+    // wraps (loop) or clamps a time in seconds to the clip
+    float WrapTime(float time, bool loop) const
+    {
+        if (duration <= 0.0f)
+            return 0.0f;
+        if (!loop)
+            return min(max(time, 0.0f), duration);
+        time = fmod(time, duration);
+        return time < 0.0f ? time + duration : time;
+    }
+
+    // overwrites the local transforms of the animated nodes (indexed like the skeleton's nodes) with the pose at time
+    void Sample(float time, glm::mat4 *locals) const
+    {
+        size_t tracks = trackNodes.size();
+        if (tracks == 0)
+            return;
+        unsigned int frame = 0;
+        float t = 0.0f;
+        if (frameCount > 1)
+        {
+            float position = min(max(time / frameTime, 0.0f), static_cast<float>(frameCount - 1));
+            frame = min(static_cast<unsigned int>(position), frameCount - 2);
+            t = position - frame;
+        }
+        unsigned int next = min(frame + 1, frameCount - 1);
+        const glm::vec3 *t0 = &translations[frame * tracks], *t1 = &translations[next * tracks];
+        const QuantizedQuat *r0 = &rotations[frame * tracks], *r1 = &rotations[next * tracks];
+        const glm::vec3 *s0 = &scales[frame * tracks], *s1 = &scales[next * tracks];
+        for (size_t track = 0; track < tracks; track++)
+        {
+            glm::vec3 translation = t0[track] + (t1[track] - t0[track]) * t;
+            glm::vec3 scale = s0[track] + (s1[track] - s0[track]) * t;
+            glm::vec4 rotation = NlerpRotation(DequantizeRotation(r0[track]), DequantizeRotation(r1[track]), t);
+            locals[trackNodes[track]] = ComposeTransform(translation, rotation, scale);
+        }
+    }
+
+private:
+    float frameTime = 0.0f;		// seconds between two frames
+    vector<int> trackNodes;		// per track: the skeleton node it animates
+    vector<glm::vec3> translations;
+    vector<QuantizedQuat> rotations;
+    vector<glm::vec3> scales;
+
+    static glm::vec3 keyValue(const aiVectorKey &key) { return glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z); }
+    static glm::vec4 keyValue(const aiQuatKey &key) { return glm::vec4(key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w); }
+    static glm::vec3 interpolate(const glm::vec3 &a, const glm::vec3 &b, float t) { return a + (b - a) * t; }
+    static glm::vec4 interpolate(const glm::vec4 &a, const glm::vec4 &b, float t) { return SlerpRotation(a, b, t); }
+
+    // the value of a channel's keys at ticks, held constant before the first and after the last key
+    template <typename Key>
+    static auto sampleKeys(const Key *keys, unsigned int count, double ticks) -> decltype(keyValue(keys[0]))
+    {
+        const Key *end = keys + count;
+        const Key *after = upper_bound(keys, end, ticks, [](double value, const Key &key) { return value < key.mTime; });
+        if (after == keys)
+            return keyValue(keys[0]);
+        if (after == end)
+            return keyValue(end[-1]);
+        const Key &before = after[-1];
+        double span = after->mTime - before.mTime;
+        float t = span > 0.0 ? static_cast<float>((ticks - before.mTime) / span) : 0.0f;
+        return interpolate(keyValue(before), keyValue(*after), t);
+    }
+};
+
+// One animated copy of a model: which clip it plays and where, and the bone matrices of its current pose, ready
+// for BonePalette::Add. Skeleton and clip have to outlive the instance.
+struct AnimationInstance {
+    const Skeleton *skeleton = nullptr;
+    const AnimationClip *clip = nullptr;
+    float time = 0.0f;		// seconds into the clip
+    float speed = 1.0f;
+    bool loop = true;
+    // per bone of the model: globalInverse * the bone node's global transform * BoneInfo::offset
+    vector<glm::mat4> boneMatrices;
+
+    AnimationInstance() {}
+    AnimationInstance(const Skeleton &skeleton, const AnimationClip &clip) : skeleton(&skeleton), clip(&clip) {}
+};
+
+// poses one instance at its current time. nodes is scratch space, it ends up holding the nodes' global transforms.
+inline void EvaluateAnimation(AnimationInstance &instance, vector<glm::mat4> &nodes)
+{
+    const Skeleton &skeleton = *instance.skeleton;
+    nodes.assign(skeleton.bindLocals.begin(), skeleton.bindLocals.end());
+    if (instance.clip != nullptr)
+        instance.clip->Sample(instance.time, nodes.data());
+    // parents come first, so each parent is already global when its children get to it
+    const int *parents = skeleton.parents.data();
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (parents[i] >= 0)
+            nodes[i] = nodes[parents[i]] * nodes[i];
+    }
+    size_t bones = skeleton.boneNodes.size();
+    instance.boneMatrices.resize(bones);
+    for (size_t bone = 0; bone < bones; bone++)
+    {
+        int node = skeleton.boneNodes[bone];
+        instance.boneMatrices[bone] = node < 0 ? glm::mat4(1.0f) : skeleton.globalInverse * nodes[node] * skeleton.boneOffsets[bone];
+    }
+}
+
+// advances every instance by deltaTime (scaled by its speed) and poses it. Batches of instancesPerJob instances run
+// on ThreadPool::Shared() while the calling thread takes the last one; it returns when all are done. Instances are
+// independent, they may use different skeletons and clips.
+inline void EvaluateAnimations(vector<AnimationInstance> &instances, float deltaTime, size_t instancesPerJob = 16)
+{
+    auto evaluateRange = [&instances, deltaTime](size_t begin, size_t end) {
+        thread_local vector<glm::mat4> nodes;
+        for (size_t i = begin; i < end; i++)
+        {
+            AnimationInstance &instance = instances[i];
+            if (instance.skeleton == nullptr)
+                continue;
+            if (instance.clip != nullptr)
+                instance.time = instance.clip->WrapTime(instance.time + deltaTime * instance.speed, instance.loop);
+            EvaluateAnimation(instance, nodes);
+        }
+    };
+
+    instancesPerJob = max<size_t>(instancesPerJob, 1);
+    size_t jobs = (instances.size() + instancesPerJob - 1) / instancesPerJob;
+    if (jobs <= 1)
+    {
+        evaluateRange(0, instances.size());
+        return;
+    }
+    WaitGroup group;
+    group.Add(jobs - 1);
+    for (size_t job = 0; job + 1 < jobs; job++)
+    {
+        size_t begin = job * instancesPerJob;
+        ThreadPool::Shared().Enqueue([&evaluateRange, &group, begin, instancesPerJob]() {
+            evaluateRange(begin, begin + instancesPerJob);
+            group.Done();
+        });
+    }
+    evaluateRange((jobs - 1) * instancesPerJob, instances.size());
+    group.Wait();
+}
+
+// reads the animations of a skinned model's file and resamples them against its bones. The file is read again
+// (without post-processing, which leaves the hierarchy alone) because the model may have come out of the mesh
+// cache. The model must be loaded (IsLoaded()). Returns false if the file has no animation that moves one of the model's bones.
+inline bool LoadAnimations(const Model &model, Skeleton &skeleton, vector<AnimationClip> &clips, float sampleRate = 30.0f)
+{
+    clips.clear();
+    Assimp::Importer importer;
+    importer.SetIOHandler(new AssetIOSystem());
+    const aiScene *scene = importer.ReadFile(model.Path(), 0);
+    if (!scene || !scene->mRootNode)
+    {
+        cout << "ERROR::ANIMATION:: " << importer.GetErrorString() << endl;
+        return false;
+    }
+    skeleton.Build(scene->mRootNode, model.bones);
+    for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+    {
+        AnimationClip clip;
+        if (clip.Build(scene->mAnimations[i], skeleton, sampleRate))
+            clips.push_back(std::move(clip));
+    }
+    return !clips.empty();
+}
+#endif
@@ -0,0 +1,354 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_utils.h"
+using namespace std;
+
+// bump whenever the layout below changes
+#define ASSET_ARCHIVE_VERSION 1
+// every file in an archive starts on a page boundary, so its bytes can be handed out straight from the mapping
+#define ASSET_ARCHIVE_ALIGNMENT 4096
+
+// Binary layout of a .pack archive:
+//   AssetArchiveHeader
+//   AssetArchiveEntry[entryCount], sorted by pathHash
+//   names (entry paths, not terminated)
+//   file data, each entry aligned to ASSET_ARCHIVE_ALIGNMENT
+// Entry paths are relative to the archive root, normalized and lower case, so lookups are case insensitive
+// on every platform. The whole archive is memory mapped; lookups binary search the hashes and compare the name.
+struct AssetArchiveHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t tocOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t reserved[3];
+};
+
+struct AssetArchiveEntry {
+    uint64_t pathHash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+// the name a path is stored and looked up under
+inline string AssetArchiveKey(const string &path)
+{
+    string key = NormalizePath(path);
+    for (char &c : key)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+    return key;
+}
+
+// a file to put into an archive: the name it's stored under and where to read it from
+struct AssetArchiveSource {
+    string name;
+    string path;
+};
+
+// Read-only view of a .pack archive. Found data points into the mapping and stays valid while the archive is open.
+class AssetArchive
+{
+public:
+    AssetArchive() {}
+    AssetArchive(const AssetArchive&) = delete;
+    AssetArchive& operator=(const AssetArchive&) = delete;
+
+    bool Open(const string &archivePath)
+    {
+        Close();
+        if (!file.Open(archivePath) || file.Size() < sizeof(AssetArchiveHeader))
+            return fail();
+        header = reinterpret_cast<const AssetArchiveHeader*>(file.Data());
+        if (memcmp(header->magic, "LOGLPACK", 8) != 0 || header->version != ASSET_ARCHIVE_VERSION)
+            return fail();
+        if (header->tocOffset + uint64_t(header->entryCount) * sizeof(AssetArchiveEntry) > file.Size() ||
+            header->namesOffset + header->namesSize > file.Size())
+            return fail();
+        entries = reinterpret_cast<const AssetArchiveEntry*>(file.Data() + header->tocOffset);
+        names = reinterpret_cast<const char*>(file.Data() + header->namesOffset);
+        for (uint32_t i = 0; i < header->entryCount; i++)
+        {
+            if (entries[i].offset + entries[i].size > file.Size() ||
+                uint64_t(entries[i].nameOffset) + entries[i].nameLength > header->namesSize)
+                return fail();
+        }
+        GetFileStamp(archivePath, stamp);
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        header = nullptr;
+        entries = nullptr;
+        names = nullptr;
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    unsigned int Count() const { return header ? header->entryCount : 0; }
+    // stamp of the archive file itself
+    const FileStamp& Stamp() const { return stamp; }
+
+    // looks up a path relative to the archive root. Returns nullptr if it isn't in the archive.
+    const AssetArchiveEntry* Find(const string &path) const
+    {
+        if (!header)
+            return nullptr;
+        string key = AssetArchiveKey(path);
+        uint64_t hash = HashString(key);
+        const AssetArchiveEntry *end = entries + header->entryCount;
+        const AssetArchiveEntry *found = lower_bound(entries, end, hash,
+            [](const AssetArchiveEntry &entry, uint64_t value) { return entry.pathHash < value; });
+        for (; found != end && found->pathHash == hash; ++found)
+        {
+            if (found->nameLength == key.size() && memcmp(names + found->nameOffset, key.data(), key.size()) == 0)
+                return found;
+        }
+        return nullptr;
+    }
+
+    const unsigned char* Data(const AssetArchiveEntry &entry) const { return file.Data() + entry.offset; }
+
+    // packs the given files into a new archive (written to a temporary file first). Returns false if a file
+    // can't be read or two names collide.
+    static bool Write(const string &archivePath, const vector<AssetArchiveSource> &sources)
+    {
+        struct Pending {
+            string key;
+            string path;
+            uint64_t size;
+        };
+        vector<Pending> files;
+        for (const AssetArchiveSource &source : sources)
+        {
+            FileStamp stamp;
+            if (!GetFileStamp(source.path, stamp))
+                return false;
+            files.push_back({ AssetArchiveKey(source.name), source.path, stamp.size });
+        }
+        sort(files.begin(), files.end(), [](const Pending &a, const Pending &b) {
+            uint64_t ha = HashString(a.key), hb = HashString(b.key);
+            return ha != hb ? ha < hb : a.key < b.key;
+        });
+        for (size_t i = 1; i < files.size(); i++)
+        {
+            if (files[i].key == files[i - 1].key)
+                return false;
+        }
+
+        AssetArchiveHeader head;
+        memset(&head, 0, sizeof(head));
+        memcpy(head.magic, "LOGLPACK", 8);
+        head.version = ASSET_ARCHIVE_VERSION;
+        head.entryCount = static_cast<uint32_t>(files.size());
+        head.tocOffset = sizeof(AssetArchiveHeader);
+        head.namesOffset = head.tocOffset + files.size() * sizeof(AssetArchiveEntry);
+
+        vector<AssetArchiveEntry> toc(files.size());
+        string nameTable;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            toc[i].pathHash = HashString(files[i].key);
+            toc[i].nameOffset = static_cast<uint32_t>(nameTable.size());
+            toc[i].nameLength = static_cast<uint32_t>(files[i].key.size());
+            toc[i].size = files[i].size;
+            nameTable += files[i].key;
+        }
+        head.namesSize = nameTable.size();
+        uint64_t offset = align(head.namesOffset + head.namesSize);
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            toc[i].offset = offset;
+            offset = align(offset + toc[i].size);
+        }
+
+        string tempPath = archivePath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+            out.write(reinterpret_cast<const char*>(toc.data()), toc.size() * sizeof(AssetArchiveEntry));
+            out.write(nameTable.data(), nameTable.size());
+            bool ok = true;
+            for (size_t i = 0; i < files.size() && ok; i++)
+            {
+                pad(out, toc[i].offset);
+                MappedFile source;
+                if (toc[i].size > 0)
+                {
+                    ok = source.Open(files[i].path) && source.Size() == toc[i].size;
+                    if (ok)
+                        out.write(reinterpret_cast<const char*>(source.Data()), source.Size());
+                }
+            }
+            pad(out, offset);
+            if (!ok || !out)
+            {
+                out.close();
+                remove(tempPath.c_str());
+                return false;
+            }
+        }
+        remove(archivePath.c_str());
+        return rename(tempPath.c_str(), archivePath.c_str()) == 0;
+    }
+
+private:
+    MappedFile file;
+    FileStamp stamp;
+    const AssetArchiveHeader *header = nullptr;
+    const AssetArchiveEntry *entries = nullptr;
+    const char *names = nullptr;
+
+    bool fail()
+    {
+        Close();
+        return false;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + ASSET_ARCHIVE_ALIGNMENT - 1) & ~uint64_t(ASSET_ARCHIVE_ALIGNMENT - 1);
+    }
+
+    static void pad(ofstream &out, uint64_t offset)
+    {
+        static const char zeros[ASSET_ARCHIVE_ALIGNMENT] = {};
+        uint64_t current = static_cast<uint64_t>(out.tellp());
+        if (offset > current)
+            out.write(zeros, static_cast<streamsize>(offset - current));
+    }
+};
+
+// Process wide set of mounted archives. A path below an archive's mount point ("resources/objects/a.png" with
+// an archive mounted at "resources") is served from the archive, anything else from the loose file.
+// Mount archives before loading anything: lookups from the loader threads don't lock.
+class AssetFileSystem
+{
+public:
+    static AssetFileSystem& Instance()
+    {
+        static AssetFileSystem fileSystem;
+        return fileSystem;
+    }
+
+    // archives mounted later take precedence over earlier ones
+    bool Mount(const string &archivePath, const string &mountPoint)
+    {
+        unique_ptr<Mounted> mounted(new Mounted());
+        if (!mounted->archive.Open(archivePath))
+            return false;
+        mounted->prefix = AssetArchiveKey(mountPoint);
+        if (!mounted->prefix.empty())
+            mounted->prefix += '/';
+        mounts.insert(mounts.begin(), move(mounted));
+        return true;
+    }
+
+    void UnmountAll() { mounts.clear(); }
+    size_t MountCount() const { return mounts.size(); }
+
+    // finds path in the mounted archives, archive receives the one holding it
+    const AssetArchiveEntry* Find(const string &path, const AssetArchive **archive = nullptr) const
+    {
+        if (mounts.empty())
+            return nullptr;
+        string key = AssetArchiveKey(path);
+        for (const unique_ptr<Mounted> &mounted : mounts)
+        {
+            if (key.compare(0, mounted->prefix.size(), mounted->prefix) != 0)
+                continue;
+            const AssetArchiveEntry *entry = mounted->archive.Find(key.substr(mounted->prefix.size()));
+            if (entry)
+            {
+                if (archive)
+                    *archive = &mounted->archive;
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct Mounted {
+        AssetArchive archive;
+        string prefix;
+    };
+    vector<unique_ptr<Mounted> > mounts;
+
+    AssetFileSystem() {}
+};
+
+// The bytes of an asset, out of a mounted archive if it's in one and otherwise from a mapping of the loose file.
+// Either way nothing is copied.
+class AssetFile
+{
+public:
+    AssetFile() {}
+    AssetFile(const AssetFile&) = delete;
+    AssetFile& operator=(const AssetFile&) = delete;
+
+    bool Open(const string &path)
+    {
+        Close();
+        const AssetArchive *archive;
+        const AssetArchiveEntry *entry = AssetFileSystem::Instance().Find(path, &archive);
+        if (entry)
+        {
+            data = archive->Data(*entry);
+            size = static_cast<size_t>(entry->size);
+            return true;
+        }
+        if (!file.Open(path))
+            return false;
+        data = file.Data();
+        size = file.Size();
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        data = nullptr;
+        size = 0;
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    MappedFile file;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+// stamp for cache invalidation: the archive's modification time and the entry's size for archived assets.
+inline bool GetAssetStamp(const string &path, FileStamp &stamp)
+{
+    const AssetArchive *archive;
+    const AssetArchiveEntry *entry = AssetFileSystem::Instance().Find(path, &archive);
+    if (!entry)
+        return GetFileStamp(path, stamp);
+    stamp.mtime = archive->Stamp().mtime;
+    stamp.size = entry->size;
+    return true;
+}
+#endif
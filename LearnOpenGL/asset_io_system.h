@@ -0,0 +1,122 @@
+#ifndef ASSET_IO_SYSTEM_H
+#define ASSET_IO_SYSTEM_H
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <cstring>
+#include <string>
+
+#include "asset_archive.h"
+using namespace std;
+
+// Assimp stream over bytes that are already in memory, e.g. an entry of a mapped archive.
+// Reads copy straight from the mapping into Assimp's buffer, without a stdio buffer in between.
+class MemoryIOStream : public Assimp::IOStream
+{
+public:
+    MemoryIOStream(const unsigned char *data, size_t size) : data(data), size(size) {}
+
+    size_t Read(void *buffer, size_t elementSize, size_t count) override
+    {
+        if (elementSize == 0 || count == 0)
+            return 0;
+        size_t available = (size - position) / elementSize;
+        count = count < available ? count : available;
+        memcpy(buffer, data + position, count * elementSize);
+        position += count * elementSize;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override { return 0; }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t target;
+        if (origin == aiOrigin_SET)
+            target = offset;
+        else if (origin == aiOrigin_CUR)
+            target = position + offset;
+        else
+            target = size + offset;
+        if (target > size)
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return size; }
+    void Flush() override {}
+
+protected:
+    const unsigned char *data;
+    size_t size;
+    size_t position = 0;
+};
+
+// Assimp stream over a memory mapping of a loose file. Assimp copies the file into its own buffer either way,
+// reading from the mapping saves the stdio buffer and the read syscalls in between.
+class MappedIOStream : public MemoryIOStream
+{
+public:
+    // returns nullptr if the file can't be mapped
+    static MappedIOStream* Open(const string &path)
+    {
+        MappedIOStream *stream = new MappedIOStream();
+        if (!stream->file.Open(path, true))
+        {
+            delete stream;
+            return nullptr;
+        }
+        stream->data = stream->file.Data();
+        stream->size = stream->file.Size();
+        return stream;
+    }
+
+private:
+    MappedFile file;
+
+    MappedIOStream() : MemoryIOStream(nullptr, 0) {}
+};
+
+// Assimp file system that reads files out of the archives mounted in the AssetFileSystem, so a model and
+// its material files come out of the pack, and memory maps all other files instead of reading them through stdio.
+// Only writes (and files that can't be mapped, such as empty ones) go to Assimp's default file system.
+// The importer takes ownership: importer.SetIOHandler(new AssetIOSystem());
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char *file) const override
+    {
+        return AssetFileSystem::Instance().Find(file) != nullptr || fallback.Exists(file);
+    }
+
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream* Open(const char *file, const char *mode = "rb") override
+    {
+        // archives are read-only
+        if (strchr(mode, 'r') && !strchr(mode, '+'))
+        {
+            const AssetArchive *archive;
+            const AssetArchiveEntry *entry = AssetFileSystem::Instance().Find(file, &archive);
+            if (entry)
+                return new MemoryIOStream(archive->Data(*entry), static_cast<size_t>(entry->size));
+            Assimp::IOStream *mapped = MappedIOStream::Open(file);
+            if (mapped)
+                return mapped;
+        }
+        return fallback.Open(file, mode);
+    }
+
+    void Close(Assimp::IOStream *stream) override
+    {
+        delete stream;
+    }
+
+private:
+    Assimp::DefaultIOSystem fallback;
+};
+#endif
@@ -0,0 +1,217 @@
+#ifndef DDS_FILE_H
+#define DDS_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "asset_archive.h"
+#include "file_utils.h"
+#include "texture_compress.h"
+using namespace std;
+
+// bump whenever the encoders in texture_compress.h change their output so cooked textures are rebuilt.
+#define TEXTURE_COOK_VERSION 1
+
+// Reads and writes cooked textures (block compressed or plain RGBA8 mip chains) as .dds files with the DX10 extension header, so the cooked
+// textures also open in the usual DDS viewers and tools:
+//   "DDS " DDSHeader DDSHeaderDX10 level 0 ... level n
+// The cooker stamps the source image's size and modification time into the header's reserved words, which lets
+// the loader tell a stale cooked texture from a fresh one without touching the source.
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    // [0] 'LOGL' tag, [1] cook version, [2..3] source mtime, [4..5] source size, [6] DDS_COOK_* flags
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+#define DDS_MAGIC          0x20534444	// "DDS "
+#define DDS_FOURCC_DX10    0x30315844	// "DX10"
+#define DDS_COOK_TAG       0x4c474f4c	// "LOGL"
+#define DDS_COOK_SRGB_MIPS 0x1
+
+// the few DXGI_FORMAT values the cooker produces
+inline uint32_t CodecToDXGIFormat(Texture_Codec codec)
+{
+    switch (codec)
+    {
+    case CODEC_BC1: return 71;
+    case CODEC_BC3: return 77;
+    case CODEC_BC5: return 83;
+    case CODEC_BC7: return 98;
+    case CODEC_RGBA8: return 28;
+    default: return 0;
+    }
+}
+
+inline Texture_Codec DXGIFormatToCodec(uint32_t format)
+{
+    switch (format)
+    {
+    case 71: return CODEC_BC1;
+    case 77: return CODEC_BC3;
+    case 83: return CODEC_BC5;
+    case 98: return CODEC_BC7;
+    case 28: return CODEC_RGBA8;
+    default: return CODEC_NONE;
+    }
+}
+
+// writes image to path (through a temporary file) with the source image's stamp.
+inline bool WriteDDS(const string &path, const TextureLevels &image, const FileStamp &source)
+{
+    if (image.codec == CODEC_NONE || image.mips.empty())
+        return false;
+
+    DDSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDSHeader);
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;	// caps, height, width, pixel format, mip count
+    header.height = image.height;
+    header.width = image.width;
+    if (image.codec == CODEC_RGBA8)
+    {
+        header.flags |= 0x8;	// pitch
+        header.pitchOrLinearSize = static_cast<uint32_t>(image.width) * 4;
+    }
+    else
+    {
+        header.flags |= 0x80000;	// linear size
+        header.pitchOrLinearSize = static_cast<uint32_t>(image.mips[0].size);
+    }
+    header.mipMapCount = static_cast<uint32_t>(image.mips.size());
+    header.reserved1[0] = DDS_COOK_TAG;
+    header.reserved1[1] = TEXTURE_COOK_VERSION;
+    header.reserved1[2] = static_cast<uint32_t>(source.mtime);
+    header.reserved1[3] = static_cast<uint32_t>(source.mtime >> 32);
+    header.reserved1[4] = static_cast<uint32_t>(source.size);
+    header.reserved1[5] = static_cast<uint32_t>(source.size >> 32);
+    header.reserved1[6] = image.srgbMips ? DDS_COOK_SRGB_MIPS : 0;
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = 0x4;	// fourCC
+    header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+    header.caps = 0x1000 | (image.mips.size() > 1 ? 0x400008 : 0);	// texture, mipmap + complex
+
+    DDSHeaderDX10 dx10;
+    memset(&dx10, 0, sizeof(dx10));
+    dx10.dxgiFormat = CodecToDXGIFormat(image.codec);
+    dx10.resourceDimension = 3;	// texture 2D
+    dx10.arraySize = 1;
+
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        uint32_t magic = DDS_MAGIC;
+        out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+        out.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+        if (!out)
+        {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    remove(path.c_str());
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+// reads a .dds file written by WriteDDS (or any other DX10 style BC1/3/5/7 or RGBA8 file).
+// If source is given, files stamped for a different source image or cook version are rejected.
+inline bool ReadDDS(const string &path, TextureLevels &image, const FileStamp *source = nullptr)
+{
+    AssetFile file;
+    if (!file.Open(path))
+        return false;
+    const size_t headersSize = sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+    if (file.Size() < headersSize)
+        return false;
+
+    uint32_t magic;
+    DDSHeader header;
+    DDSHeaderDX10 dx10;
+    memcpy(&magic, file.Data(), sizeof(magic));
+    memcpy(&header, file.Data() + sizeof(magic), sizeof(header));
+    memcpy(&dx10, file.Data() + sizeof(magic) + sizeof(header), sizeof(dx10));
+    if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.pixelFormat.fourCC != DDS_FOURCC_DX10)
+        return false;
+    if (source)
+    {
+        uint64_t mtime = header.reserved1[2] | (uint64_t(header.reserved1[3]) << 32);
+        uint64_t size = header.reserved1[4] | (uint64_t(header.reserved1[5]) << 32);
+        if (header.reserved1[0] != DDS_COOK_TAG || header.reserved1[1] != TEXTURE_COOK_VERSION ||
+            mtime != source->mtime || size != source->size)
+            return false;
+    }
+
+    Texture_Codec codec = DXGIFormatToCodec(dx10.dxgiFormat);
+    if (codec == CODEC_NONE || dx10.arraySize > 1 || header.width == 0 || header.height == 0)
+        return false;
+
+    image.codec = codec;
+    image.width = static_cast<int>(header.width);
+    image.height = static_cast<int>(header.height);
+    image.srgbMips = header.reserved1[0] == DDS_COOK_TAG && (header.reserved1[6] & DDS_COOK_SRGB_MIPS) != 0;
+    image.mips.clear();
+    // a full chain ends at 1x1, anything longer is a corrupt header
+    uint32_t maxLevels = 1;
+    for (uint32_t size = max(header.width, header.height); size > 1; size /= 2)
+        maxLevels++;
+    uint32_t levels = header.mipMapCount > 0 ? header.mipMapCount : 1;
+    if (levels > maxLevels)
+        return false;
+    size_t offset = 0;
+    int width = image.width, height = image.height;
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        TextureLevel mip;
+        mip.width = width;
+        mip.height = height;
+        mip.offset = offset;
+        mip.size = TextureLevelSize(codec, width, height);
+        offset += mip.size;
+        image.mips.push_back(mip);
+        width = max(1, width / 2);
+        height = max(1, height / 2);
+    }
+    if (file.Size() - headersSize < offset)
+        return false;
+    image.data.assign(file.Data() + headersSize, file.Data() + headersSize + offset);
+    return true;
+}
+#endif
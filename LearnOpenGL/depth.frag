@@ -0,0 +1,6 @@
+#version 410 core
+
+// depth only: nothing is written besides the depth buffer.
+void main()
+{
+}
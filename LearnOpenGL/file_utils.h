@@ -0,0 +1,217 @@
+#ifndef FILE_UTILS_H
+#define FILE_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// 64-bit FNV-1a hash, used to key caches by path or by content.
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline uint64_t HashString(const std::string &str)
+{
+    return HashBytes(str.data(), str.size());
+}
+
+// turns "dir\\sub/../a.png" and "dir/./a.png" into "dir/a.png" so both map to the same key.
+inline std::string NormalizePath(const std::string &path)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+    for (size_t i = 0; i <= path.size(); i++)
+    {
+        char c = i < path.size() ? path[i] : '/';
+        if (c != '/' && c != '\\')
+        {
+#ifdef _WIN32
+            // paths are case insensitive on windows
+            if (c >= 'A' && c <= 'Z')
+                c = static_cast<char>(c - 'A' + 'a');
+#endif
+            part += c;
+            continue;
+        }
+        if (part == "..")
+        {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!absolute)
+                parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".")
+        {
+            parts.push_back(part);
+        }
+        part.clear();
+    }
+
+    std::string normalized = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        if (i > 0)
+            normalized += '/';
+        normalized += parts[i];
+    }
+    return normalized;
+}
+
+// modification time and size of a file on disk, used to detect stale caches.
+struct FileStamp {
+    uint64_t mtime = 0;
+    uint64_t size = 0;
+};
+
+inline bool GetFileStamp(const std::string &path, FileStamp &stamp)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    stamp.mtime = static_cast<uint64_t>(info.st_mtime);
+    stamp.size = static_cast<uint64_t>(info.st_size);
+    return true;
+}
+
+// asks the OS to drop the file's cached pages, so the next read comes from the disk. Used to measure cold loads;
+// pages that are mapped or dirty may stay. On windows, opening the file unbuffered flushes its cached data.
+inline bool EvictFromPageCache(const std::string &path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    CloseHandle(file);
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#endif
+}
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the object does.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential: the file will be read front to back once, so the OS should read ahead aggressively and may drop
+    // pages behind the reader (madvise(MADV_SEQUENTIAL), FILE_FLAG_SEQUENTIAL_SCAN on windows).
+    bool Open(const std::string &path, bool sequential = false)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            Close();
+            return false;
+        }
+        data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            Close();
+            return false;
+        }
+        void *ptr = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            data = static_cast<const unsigned char*>(ptr);
+            size = static_cast<size_t>(info.st_size);
+            if (sequential)
+                madvise(ptr, size, MADV_SEQUENTIAL);
+        }
+#endif
+        if (!data)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+#endif
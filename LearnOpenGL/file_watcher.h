@@ -0,0 +1,180 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "file_utils.h"
+using namespace std;
+
+// Reports changes to a set of files, for reloading assets while the app runs.
+// On Linux an inotify instance watches the directories holding the files: editors often save by writing a new
+// file and renaming it over the old one, which a watch on the file itself would lose track of. Elsewhere (and for
+// directories inotify refuses) the files' stamps are compared every pollInterval.
+// Poll() never blocks. It returns a changed file only once nothing touched it for settleTime, so a file that is
+// written in several steps is reported once, after the last one.
+//   FileWatcher watcher;
+//   watcher.Watch("resources/objects/backpack/diffuse.jpg");
+//   for (const string &path : watcher.Poll())    // once per frame, returns normalized paths
+//       ...
+class FileWatcher
+{
+public:
+    chrono::milliseconds settleTime{ 150 };
+    chrono::milliseconds pollInterval{ 500 };
+
+    FileWatcher()
+    {
+#ifdef __linux__
+        notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (notifyFd >= 0)
+            close(notifyFd);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // starts watching a file; watching it again does nothing. The file doesn't have to exist yet.
+    void Watch(const string &path)
+    {
+        string key = NormalizePath(path);
+        if (files.find(key) != files.end())
+            return;
+        Watched &file = files[key];
+        file.exists = GetFileStamp(key, file.stamp);
+        file.polled = !watchDirectory(key);
+    }
+
+    void Unwatch(const string &path)
+    {
+        // the directory watch stays, events for files nobody watches anymore are dropped
+        files.erase(NormalizePath(path));
+    }
+
+    bool IsWatched(const string &path) const { return files.find(NormalizePath(path)) != files.end(); }
+    size_t Count() const { return files.size(); }
+
+    // collects what changed since the last call and returns the files that have settled since.
+    vector<string> Poll()
+    {
+        Clock::time_point now = Clock::now();
+        readEvents(now);
+        if (now - lastScan >= pollInterval)
+        {
+            lastScan = now;
+            for (auto &item : files)
+            {
+                Watched &file = item.second;
+                if (!file.polled)
+                    continue;
+                FileStamp stamp;
+                bool exists = GetFileStamp(item.first, stamp);
+                if (exists != file.exists || stamp.mtime != file.stamp.mtime || stamp.size != file.stamp.size)
+                    touch(file, now);
+                file.exists = exists;
+                file.stamp = stamp;
+            }
+        }
+
+        vector<string> changed;
+        for (auto &item : files)
+        {
+            Watched &file = item.second;
+            if (!file.dirty || now - file.changedAt < settleTime)
+                continue;
+            file.dirty = false;
+            file.exists = GetFileStamp(item.first, file.stamp);
+            // deleted (and not written again), there is nothing to reload
+            if (file.exists)
+                changed.push_back(item.first);
+        }
+        return changed;
+    }
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    struct Watched {
+        FileStamp stamp;
+        bool exists = false;
+        // no directory watch, changes are found by comparing stamps
+        bool polled = true;
+        bool dirty = false;
+        Clock::time_point changedAt;
+    };
+
+    unordered_map<string, Watched> files;	// normalized path -> state
+    Clock::time_point lastScan;
+
+    static void touch(Watched &file, Clock::time_point now)
+    {
+        file.dirty = true;
+        file.changedAt = now;
+    }
+
+#ifdef __linux__
+    int notifyFd = -1;
+    unordered_map<int, string> directories;	// inotify watch -> directory prefix ("" for the working directory)
+    unordered_map<string, int> watchByDirectory;
+
+    bool watchDirectory(const string &path)
+    {
+        if (notifyFd < 0)
+            return false;
+        size_t slash = path.find_last_of('/');
+        string prefix = slash == string::npos ? string() : path.substr(0, slash + 1);
+        if (watchByDirectory.find(prefix) != watchByDirectory.end())
+            return true;
+        int wd = inotify_add_watch(notifyFd, prefix.empty() ? "." : prefix.c_str(),
+            IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+            return false;
+        directories[wd] = prefix;
+        watchByDirectory[prefix] = wd;
+        return true;
+    }
+
+    void readEvents(Clock::time_point now)
+    {
+        if (notifyFd < 0)
+            return;
+        alignas(inotify_event) char buffer[16 * 1024];
+        for (;;)
+        {
+            ssize_t length = read(notifyFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                return;
+            for (ssize_t offset = 0; offset < length; )
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                auto directory = directories.find(event->wd);
+                if (event->len == 0 || directory == directories.end())
+                    continue;
+                auto found = files.find(directory->second + event->name);
+                if (found != files.end())
+                    touch(found->second, now);
+            }
+        }
+    }
+#else
+    bool watchDirectory(const string&) { return false; }
+    void readEvents(Clock::time_point) {}
+#endif
+};
+#endif
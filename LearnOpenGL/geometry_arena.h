@@ -0,0 +1,178 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "gpu_resources.h"
+#include "mesh.h"
+using namespace std;
+
+// One vertex buffer and one element buffer shared by many meshes of the same vertex layout, with a single VAO
+// (plus one over the optional position-only stream). Meshes keep their own 0 based indices and are drawn with
+// glDrawElementsBaseVertex, so consecutive draws don't rebind anything and GPU memory isn't split into a pair
+// of small buffers per mesh.
+// The buffers grow on demand by copying into bigger ones on the GPU (glCopyBufferSubData); VAO ids never change,
+// so slices handed out earlier stay valid. Meshes are only appended, the arena is freed as a whole.
+// All member functions must run on the GL context thread.
+class GeometryArena
+{
+public:
+    // skinned: reserve the packed bone stream for every vertex (PACKED_VERTEX only, FULL_VERTEX stores bones inline).
+    // positionStream: keep a tightly packed copy of all positions for depth passes.
+    GeometryArena(Vertex_Format format, bool skinned = false, bool positionStream = false)
+        : format(format), skinned(skinned && format == PACKED_VERTEX), positionStream(positionStream)
+    {
+        glGenVertexArrays(1, &VAO);
+        if (positionStream)
+            glGenVertexArrays(1, &depthVAO);
+    }
+
+    ~GeometryArena()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        if (depthVAO != 0)
+            glDeleteVertexArrays(1, &depthVAO);
+        unsigned int buffers[] = { VBO, EBO, boneVBO, positionVBO };
+        for (unsigned int buffer : buffers)
+        {
+            if (buffer != 0)
+            {
+                GpuResourceManager::Instance().BufferDeleted(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    Vertex_Format Format() const { return format; }
+    bool Skinned() const { return skinned; }
+    bool HasPositionStream() const { return positionStream; }
+    size_t VertexCount() const { return vertexCount; }
+    size_t IndexCount() const { return indexCount; }
+
+    // grows the buffers so that many more vertices and indices fit without another reallocation.
+    void Reserve(size_t extraVertices, size_t extraIndices)
+    {
+        if (vertexCount + extraVertices > vertexCapacity)
+            growVertices(vertexCount + extraVertices);
+        if (indexCount + extraIndices > indexCapacity)
+            growIndices(indexCount + extraIndices);
+    }
+
+    // appends a mesh and returns where it went. The data is converted to the arena's format and uploaded right away.
+    GeometrySlice Add(const Vertex *vertexData, size_t count, const unsigned int *indexData, size_t indices)
+    {
+        if (vertexCount + count > vertexCapacity)
+            growVertices(max(vertexCount + count, vertexCapacity * 2));
+        if (indexCount + indices > indexCapacity)
+            growIndices(max(indexCount + indices, indexCapacity * 2));
+
+        ConvertedVertices converted;
+        ConvertVertices(vertexData, count, format, skinned, positionStream, converted);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (format == PACKED_VERTEX)
+            glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), count * sizeof(PackedVertex), converted.packed.data());
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), count * sizeof(Vertex), vertexData);
+        if (skinned)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, boneVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedBoneData), count * sizeof(PackedBoneData), converted.bones.data());
+        }
+        if (positionStream)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), count * sizeof(glm::vec3), converted.positions.data());
+        }
+        // the element buffer is VAO state, don't disturb whatever VAO is bound by going through GL_ELEMENT_ARRAY_BUFFER
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), indices * sizeof(unsigned int), indexData);
+
+        GeometrySlice slice;
+        slice.VAO = VAO;
+        slice.depthVAO = depthVAO;
+        slice.baseVertex = static_cast<int>(vertexCount);
+        slice.firstIndex = static_cast<unsigned int>(indexCount);
+        slice.vertexCount = static_cast<unsigned int>(count);
+        slice.indexCount = static_cast<unsigned int>(indices);
+        slice.format = format;
+        slice.hasBones = skinned || (format == FULL_VERTEX && HasBoneWeights(vertexData, count));
+        vertexCount += count;
+        indexCount += indices;
+        return slice;
+    }
+
+private:
+    Vertex_Format format;
+    bool skinned;
+    bool positionStream;
+    unsigned int VAO = 0, depthVAO = 0;
+    unsigned int VBO = 0, EBO = 0, boneVBO = 0, positionVBO = 0;
+    size_t vertexCount = 0, vertexCapacity = 0;
+    size_t indexCount = 0, indexCapacity = 0;
+
+    // replaces buffer with a bigger one holding the same first usedBytes.
+    static void growBuffer(unsigned int &buffer, size_t usedBytes, size_t newBytes)
+    {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+        GpuResourceManager &resources = GpuResourceManager::Instance();
+        resources.BufferAllocated(grown, newBytes);
+        if (buffer != 0)
+        {
+            if (usedBytes > 0)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+            }
+            resources.BufferDeleted(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = grown;
+    }
+
+    void growVertices(size_t capacity)
+    {
+        growBuffer(VBO, vertexCount * VertexStride(format), capacity * VertexStride(format));
+        if (skinned)
+            growBuffer(boneVBO, vertexCount * sizeof(PackedBoneData), capacity * sizeof(PackedBoneData));
+        if (positionStream)
+            growBuffer(positionVBO, vertexCount * sizeof(glm::vec3), capacity * sizeof(glm::vec3));
+        vertexCapacity = capacity;
+
+        // attribute pointers capture the buffer they were set with, point them at the new ones
+        glBindVertexArray(VAO);
+        SetupVertexAttributes(format, VBO, boneVBO);
+        if (positionStream)
+        {
+            glBindVertexArray(depthVAO);
+            SetupPositionAttribute(positionVBO);
+        }
+        glBindVertexArray(0);
+    }
+
+    void growIndices(size_t capacity)
+    {
+        growBuffer(EBO, indexCount * sizeof(unsigned int), capacity * sizeof(unsigned int));
+        indexCapacity = capacity;
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (positionStream)
+        {
+            glBindVertexArray(depthVAO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        }
+        glBindVertexArray(0);
+    }
+};
+#endif
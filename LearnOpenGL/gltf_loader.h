@@ -0,0 +1,794 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "asset_archive.h"
+#include "mesh.h"
+using namespace std;
+
+// Native glTF 2.0 loader, the fast path Model takes for .glb (and .gltf with external buffers) instead of Assimp.
+// The file is memory mapped and the JSON parsed into accessor/buffer view tables; geometry is read straight out
+// of the mapped buffers into Mesh's Vertex layout:
+//   - float attributes are copied with the accessor's stride, no conversion per component
+//   - normalized integer texture coordinates (KHR_mesh_quantization style) are converted on the way
+//   - 32 bit indices are a single memcpy, 8 and 16 bit ones are widened
+// Images stored in buffer views stay in the mapping and are named "*<image index>" like Assimp names embedded
+// textures, see EmbeddedImage(). The model has to stay open until they are decoded.
+// Node transforms are ignored and meshes are emitted in scene order, the same way Model treats Assimp scenes.
+// Texture coordinates stay as stored: glTF's top left origin is what stb_image's row order expects, and it's what
+// Assimp ends up with too (its glTF importer flips v and aiProcess_FlipUVs flips it back).
+
+// glTF constants this loader understands
+#define GLTF_BYTE           5120
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+#define GLTF_TRIANGLES      4
+
+// A minimal JSON document: enough for glTF, no writer.
+struct JsonValue {
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+    Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    string text;
+    vector<JsonValue> items;	// array elements
+    vector<pair<string, JsonValue> > members;	// object members in file order
+
+    // member lookup; a null value if there is no such member
+    const JsonValue& operator[](const char *key) const
+    {
+        for (const pair<string, JsonValue> &member : members)
+        {
+            if (member.first == key)
+                return member.second;
+        }
+        return Null();
+    }
+
+    const JsonValue& operator[](size_t index) const { return index < items.size() ? items[index] : Null(); }
+
+    size_t Size() const { return items.size(); }
+    bool IsNull() const { return type == JSON_NULL; }
+    int Int(int fallback = -1) const { return type == JSON_NUMBER ? static_cast<int>(number) : fallback; }
+    size_t Offset() const { return type == JSON_NUMBER && number > 0.0 ? static_cast<size_t>(number) : 0; }
+    const string& String() const { return text; }
+
+    static const JsonValue& Null()
+    {
+        static const JsonValue null;
+        return null;
+    }
+};
+
+namespace gltf_detail
+{
+    class JsonParser
+    {
+    public:
+        JsonParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+        bool Parse(JsonValue &value)
+        {
+            if (!parseValue(value, 0))
+                return false;
+            skipSpace();
+            return p == end;
+        }
+
+    private:
+        const char *p;
+        const char *end;
+
+        void skipSpace()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                p++;
+        }
+
+        bool literal(const char *word)
+        {
+            size_t length = strlen(word);
+            if (static_cast<size_t>(end - p) < length || memcmp(p, word, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        bool parseValue(JsonValue &value, int depth)
+        {
+            if (depth > 64)
+                return false;
+            skipSpace();
+            if (p == end)
+                return false;
+            switch (*p)
+            {
+            case '{': return parseObject(value, depth);
+            case '[': return parseArray(value, depth);
+            case '"':
+                value.type = JsonValue::JSON_STRING;
+                return parseString(value.text);
+            case 't':
+                value.type = JsonValue::JSON_BOOL;
+                value.boolean = true;
+                return literal("true");
+            case 'f':
+                value.type = JsonValue::JSON_BOOL;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return parseNumber(value);
+            }
+        }
+
+        bool parseObject(JsonValue &value, int depth)
+        {
+            value.type = JsonValue::JSON_OBJECT;
+            p++;
+            skipSpace();
+            if (p < end && *p == '}')
+            {
+                p++;
+                return true;
+            }
+            for (;;)
+            {
+                skipSpace();
+                value.members.push_back(make_pair(string(), JsonValue()));
+                if (p == end || *p != '"' || !parseString(value.members.back().first))
+                    return false;
+                skipSpace();
+                if (p == end || *p++ != ':')
+                    return false;
+                if (!parseValue(value.members.back().second, depth + 1))
+                    return false;
+                skipSpace();
+                if (p == end)
+                    return false;
+                if (*p == '}')
+                {
+                    p++;
+                    return true;
+                }
+                if (*p++ != ',')
+                    return false;
+            }
+        }
+
+        bool parseArray(JsonValue &value, int depth)
+        {
+            value.type = JsonValue::JSON_ARRAY;
+            p++;
+            skipSpace();
+            if (p < end && *p == ']')
+            {
+                p++;
+                return true;
+            }
+            for (;;)
+            {
+                value.items.push_back(JsonValue());
+                if (!parseValue(value.items.back(), depth + 1))
+                    return false;
+                skipSpace();
+                if (p == end)
+                    return false;
+                if (*p == ']')
+                {
+                    p++;
+                    return true;
+                }
+                if (*p++ != ',')
+                    return false;
+            }
+        }
+
+        static void appendUtf8(string &out, unsigned int code)
+        {
+            if (code < 0x80)
+            {
+                out += static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool parseHex4(unsigned int &code)
+        {
+            if (end - p < 4)
+                return false;
+            code = 0;
+            for (int i = 0; i < 4; i++, p++)
+            {
+                char c = *p;
+                code <<= 4;
+                if (c >= '0' && c <= '9')
+                    code |= c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    code |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    code |= c - 'A' + 10;
+                else
+                    return false;
+            }
+            return true;
+        }
+
+        bool parseString(string &out)
+        {
+            p++;
+            for (;;)
+            {
+                const char *start = p;
+                while (p < end && *p != '"' && *p != '\\')
+                    p++;
+                out.append(start, p);
+                if (p == end)
+                    return false;
+                if (*p++ == '"')
+                    return true;
+                if (p == end)
+                    return false;
+                char escape = *p++;
+                switch (escape)
+                {
+                case '"': case '\\': case '/': out += escape; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    unsigned int code;
+                    if (!parseHex4(code))
+                        return false;
+                    // surrogate pair
+                    if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        p += 2;
+                        unsigned int low;
+                        if (!parseHex4(low))
+                            return false;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+        }
+
+        bool parseNumber(JsonValue &value)
+        {
+            // strtod needs a terminated string; numbers are short
+            char buffer[64];
+            size_t length = 0;
+            while (p + length < end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", p[length]))
+                length++;
+            if (length == 0)
+                return false;
+            memcpy(buffer, p, length);
+            buffer[length] = 0;
+            char *parsedEnd;
+            value.number = strtod(buffer, &parsedEnd);
+            if (parsedEnd != buffer + length)
+                return false;
+            value.type = JsonValue::JSON_NUMBER;
+            p += length;
+            return true;
+        }
+    };
+
+    struct BufferView {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+        size_t stride = 0;	// 0: tightly packed
+    };
+
+    struct Accessor {
+        const unsigned char *data = nullptr;	// first element
+        size_t count = 0;
+        size_t stride = 0;
+        int componentType = 0;
+        int components = 0;
+        bool normalized = false;
+    };
+
+    inline int componentCount(const string &type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    inline size_t componentSize(int componentType)
+    {
+        switch (componentType)
+        {
+        case GLTF_BYTE:
+        case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT:
+        case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT:
+        case GLTF_FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    // one component of any type as float, normalized integers mapped to [0, 1] or [-1, 1]
+    inline float readComponent(const unsigned char *data, int componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case GLTF_FLOAT: { float v; memcpy(&v, data, 4); return v; }
+        case GLTF_UNSIGNED_BYTE: return normalized ? data[0] / 255.0f : data[0];
+        case GLTF_BYTE: { float v = static_cast<signed char>(data[0]); return normalized ? max(v / 127.0f, -1.0f) : v; }
+        case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, data, 2); return normalized ? v / 65535.0f : v; }
+        case GLTF_SHORT: { int16_t v; memcpy(&v, data, 2); return normalized ? max(v / 32767.0f, -1.0f) : v; }
+        case GLTF_UNSIGNED_INT: { uint32_t v; memcpy(&v, data, 4); return static_cast<float>(v); }
+        default: return 0.0f;
+        }
+    }
+
+    // copies the first N components of every element into a float member of each Vertex (at byte offset member).
+    // Float data is a plain strided copy; anything else is converted per component.
+    template <int N>
+    void copyAttribute(const Accessor &accessor, vector<Vertex> &vertices, size_t member)
+    {
+        unsigned char *out = reinterpret_cast<unsigned char*>(vertices.data()) + member;
+        const unsigned char *in = accessor.data;
+        if (accessor.componentType == GLTF_FLOAT)
+        {
+            for (size_t i = 0; i < accessor.count; i++, in += accessor.stride, out += sizeof(Vertex))
+                memcpy(out, in, N * sizeof(float));
+            return;
+        }
+        size_t size = componentSize(accessor.componentType);
+        for (size_t i = 0; i < accessor.count; i++, in += accessor.stride, out += sizeof(Vertex))
+        {
+            float values[N];
+            for (int c = 0; c < N; c++)
+                values[c] = readComponent(in + c * size, accessor.componentType, accessor.normalized);
+            memcpy(out, values, sizeof(values));
+        }
+    }
+}
+
+inline bool HasGltfExtension(const string &path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos)
+        return false;
+    string extension = path.substr(dot + 1);
+    for (char &c : extension)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return extension == "glb" || extension == "gltf";
+}
+
+// the textures Model uses, as image indices (-1 if the material has none)
+struct GltfMaterial {
+    int baseColorImage = -1;
+    int normalImage = -1;
+};
+
+struct GltfImage {
+    // external image file relative to the model's directory, empty for images stored in a buffer view
+    string uri;
+    // encoded bytes inside the mapped model when uri is empty
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+// one triangle list; the attribute values are accessor indices, -1 if absent
+struct GltfPrimitive {
+    int position = -1;
+    int normal = -1;
+    int texCoord = -1;
+    int tangent = -1;
+    int indices = -1;
+    int material = -1;
+};
+
+// A parsed glTF 2.0 model. Open() maps the file and reads the JSON; geometry is only touched by ReadPrimitive,
+// which may run for several primitives in parallel.
+class GltfModel
+{
+public:
+    GltfModel() {}
+    GltfModel(const GltfModel&) = delete;
+    GltfModel& operator=(const GltfModel&) = delete;
+
+    bool Open(const string &path)
+    {
+        using namespace gltf_detail;
+        if (!file.Open(path))
+            return fail(path, "can't read file");
+        const unsigned char *data = file.Data();
+        size_t size = file.Size();
+        const char *json = reinterpret_cast<const char*>(data);
+        size_t jsonSize = size;
+        const unsigned char *binary = nullptr;
+        size_t binarySize = 0;
+        // GLB: 12 byte header, a JSON chunk and an optional binary chunk, each with an 8 byte chunk header
+        uint32_t header[3] = {};
+        if (size >= 12)
+            memcpy(header, data, 12);
+        if (header[0] == 0x46546C67)	// "glTF"
+        {
+            if (header[1] != 2 || header[2] > size || size < 20)
+                return fail(path, "unsupported GLB header");
+            uint32_t chunk[2];
+            memcpy(chunk, data + 12, 8);
+            if (chunk[1] != 0x4E4F534A || 20 + uint64_t(chunk[0]) > header[2])	// "JSON"
+                return fail(path, "missing JSON chunk");
+            json = reinterpret_cast<const char*>(data + 20);
+            jsonSize = chunk[0];
+            size_t next = 20 + ((chunk[0] + 3) & ~size_t(3));
+            if (next + 8 <= header[2])
+            {
+                memcpy(chunk, data + next, 8);
+                if (chunk[1] == 0x004E4942 && next + 8 + uint64_t(chunk[0]) <= header[2])	// "BIN"
+                {
+                    binary = data + next + 8;
+                    binarySize = chunk[0];
+                }
+            }
+        }
+        JsonParser parser(json, json + jsonSize);
+        if (!parser.Parse(document))
+            return fail(path, "malformed JSON");
+        if (document["asset"]["version"].String().compare(0, 1, "2") != 0)
+            return fail(path, "not glTF 2.0");
+
+        string directory = path.substr(0, path.find_last_of("/\\") == string::npos ? 0 : path.find_last_of("/\\") + 1);
+        const JsonValue &buffers = document["buffers"];
+        for (size_t i = 0; i < buffers.Size(); i++)
+        {
+            const JsonValue &buffer = buffers[i];
+            const string &uri = buffer["uri"].String();
+            BufferRange range;
+            if (uri.empty())
+            {
+                // only the GLB binary chunk can be without uri
+                if (i != 0 || !binary)
+                    return fail(path, "buffer without data");
+                range.data = binary;
+                range.size = binarySize;
+            }
+            else
+            {
+                if (uri.compare(0, 5, "data:") == 0)
+                    return fail(path, "data uris are not supported");
+                unique_ptr<AssetFile> external(new AssetFile());
+                if (!external->Open(directory + uri))
+                    return fail(path, "can't read buffer " + uri);
+                range.data = external->Data();
+                range.size = external->Size();
+                externalBuffers.push_back(move(external));
+            }
+            if (buffer["byteLength"].Offset() > range.size)
+                return fail(path, "buffer too short");
+            bufferRanges.push_back(range);
+        }
+
+        const JsonValue &views = document["bufferViews"];
+        for (size_t i = 0; i < views.Size(); i++)
+        {
+            const JsonValue &view = views[i];
+            size_t buffer = static_cast<size_t>(view["buffer"].Int());
+            size_t offset = view["byteOffset"].Offset(), length = view["byteLength"].Offset();
+            if (buffer >= bufferRanges.size() || offset > bufferRanges[buffer].size || length > bufferRanges[buffer].size - offset)
+                return fail(path, "buffer view out of range");
+            BufferView result;
+            result.data = bufferRanges[buffer].data + offset;
+            result.size = length;
+            result.stride = view["byteStride"].Offset();
+            bufferViews.push_back(result);
+        }
+
+        const JsonValue &accessorList = document["accessors"];
+        for (size_t i = 0; i < accessorList.Size(); i++)
+        {
+            const JsonValue &accessor = accessorList[i];
+            Accessor result;
+            result.count = accessor["count"].Offset();
+            result.componentType = accessor["componentType"].Int();
+            result.components = componentCount(accessor["type"].String());
+            result.normalized = accessor["normalized"].boolean;
+            size_t elementSize = componentSize(result.componentType) * result.components;
+            int view = accessor["bufferView"].Int();
+            // sparse accessors and accessors without a view (all zeros) aren't supported, callers fall back to Assimp
+            if (!accessor["sparse"].IsNull() || view < 0 || static_cast<size_t>(view) >= bufferViews.size() || elementSize == 0)
+            {
+                accessors.push_back(Accessor());
+                continue;
+            }
+            const BufferView &bufferView = bufferViews[view];
+            result.stride = bufferView.stride ? bufferView.stride : elementSize;
+            size_t offset = accessor["byteOffset"].Offset();
+            // checked without computing offset + stride * (count - 1), which can wrap around for hostile counts
+            if (offset > bufferView.size || (result.count > 0 && (elementSize > bufferView.size - offset ||
+                result.count - 1 > (bufferView.size - offset - elementSize) / result.stride)))
+                return fail(path, "accessor out of range");
+            result.data = bufferView.data + offset;
+            accessors.push_back(result);
+        }
+
+        const JsonValue &imageList = document["images"];
+        for (size_t i = 0; i < imageList.Size(); i++)
+        {
+            const JsonValue &image = imageList[i];
+            GltfImage result;
+            result.uri = image["uri"].String();
+            int view = image["bufferView"].Int();
+            if (result.uri.empty() && view >= 0 && static_cast<size_t>(view) < bufferViews.size())
+            {
+                result.data = bufferViews[view].data;
+                result.size = bufferViews[view].size;
+            }
+            images.push_back(result);
+        }
+
+        const JsonValue &textures = document["textures"];
+        const JsonValue &materialList = document["materials"];
+        for (size_t i = 0; i < materialList.Size(); i++)
+        {
+            const JsonValue &material = materialList[i];
+            GltfMaterial result;
+            result.baseColorImage = textures[static_cast<size_t>(material["pbrMetallicRoughness"]["baseColorTexture"]["index"].Int())]["source"].Int();
+            result.normalImage = textures[static_cast<size_t>(material["normalTexture"]["index"].Int())]["source"].Int();
+            if (result.baseColorImage >= static_cast<int>(images.size()))
+                result.baseColorImage = -1;
+            if (result.normalImage >= static_cast<int>(images.size()))
+                result.normalImage = -1;
+            materials.push_back(result);
+        }
+
+        // primitives of the meshes the default scene's nodes reference, depth first
+        const JsonValue &scenes = document["scenes"];
+        const JsonValue &scene = scenes[static_cast<size_t>(max(document["scene"].Int(0), 0))];
+        if (scene.IsNull())
+        {
+            for (size_t i = 0; i < document["meshes"].Size(); i++)
+                addMesh(static_cast<int>(i));
+        }
+        for (size_t i = 0; i < scene["nodes"].Size(); i++)
+            addNode(scene["nodes"][i].Int(), 0);
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        externalBuffers.clear();
+        document = JsonValue();
+        bufferRanges.clear();
+        bufferViews.clear();
+        accessors.clear();
+        primitives.clear();
+        images.clear();
+        materials.clear();
+    }
+
+    bool IsOpen() const { return file.IsOpen(); }
+
+    size_t PrimitiveCount() const { return primitives.size(); }
+    const GltfPrimitive& Primitive(size_t index) const { return primitives[index]; }
+    const vector<GltfMaterial>& Materials() const { return materials; }
+    const vector<GltfImage>& Images() const { return images; }
+    // skins (joints and weights) aren't read
+    bool HasSkins() const { return document["skins"].Size() > 0; }
+
+    // the encoded bytes of an image stored in a buffer view, by its "*<index>" name. nullptr for anything else.
+    const GltfImage* EmbeddedImage(const string &name) const
+    {
+        if (name.size() < 2 || name[0] != '*')
+            return nullptr;
+        char *end;
+        unsigned long index = strtoul(name.c_str() + 1, &end, 10);
+        if (*end != 0 || index >= images.size() || !images[index].data)
+            return nullptr;
+        return &images[index];
+    }
+
+    // reads a primitive into Mesh's layout. Missing normals are generated like Assimp's GenSmoothNormals, missing
+    // tangents like CalcTangentSpace if generateTangents is set. Thread safe for different primitives.
+    bool ReadPrimitive(size_t index, vector<Vertex> &vertices, vector<unsigned int> &indices, bool generateTangents = true) const
+    {
+        using namespace gltf_detail;
+        const GltfPrimitive &primitive = primitives[index];
+        const Accessor *position = accessor(primitive.position, 3);
+        if (!position || position->componentType != GLTF_FLOAT)
+            return false;
+        const Accessor *normal = accessor(primitive.normal, 3);
+        const Accessor *texCoord = accessor(primitive.texCoord, 2);
+        const Accessor *tangent = accessor(primitive.tangent, 4);
+        size_t count = position->count;
+        if ((normal && normal->count != count) || (texCoord && texCoord->count != count) || (tangent && tangent->count != count))
+            return false;
+
+        Vertex blank;
+        blank.Position = blank.Normal = blank.Tangent = blank.Bitangent = glm::vec3(0.0f);
+        blank.TexCoords = glm::vec2(0.0f);
+        SetVertexBoneDataToDefault(blank);
+        vertices.assign(count, blank);
+        copyAttribute<3>(*position, vertices, offsetof(Vertex, Position));
+        if (normal)
+            copyAttribute<3>(*normal, vertices, offsetof(Vertex, Normal));
+        if (texCoord)
+            copyAttribute<2>(*texCoord, vertices, offsetof(Vertex, TexCoords));
+        if (tangent)
+            copyAttribute<3>(*tangent, vertices, offsetof(Vertex, Tangent));
+
+        if (primitive.indices >= 0)
+        {
+            const Accessor *indexAccessor = accessor(primitive.indices, 1);
+            if (!indexAccessor)
+                return false;
+            indices.resize(indexAccessor->count);
+            const unsigned char *in = indexAccessor->data;
+            size_t stride = indexAccessor->stride;
+            switch (indexAccessor->componentType)
+            {
+            case GLTF_UNSIGNED_INT:
+                if (stride == 4)
+                {
+                    if (!indices.empty())
+                        memcpy(indices.data(), in, indices.size() * 4);
+                    break;
+                }
+                for (size_t i = 0; i < indices.size(); i++, in += stride)
+                    memcpy(&indices[i], in, 4);
+                break;
+            case GLTF_UNSIGNED_SHORT:
+                for (size_t i = 0; i < indices.size(); i++, in += stride)
+                {
+                    uint16_t value;
+                    memcpy(&value, in, 2);
+                    indices[i] = value;
+                }
+                break;
+            case GLTF_UNSIGNED_BYTE:
+                for (size_t i = 0; i < indices.size(); i++, in += stride)
+                    indices[i] = in[0];
+                break;
+            default:
+                return false;
+            }
+            for (unsigned int value : indices)
+            {
+                if (value >= count)
+                    return false;
+            }
+        }
+        else
+        {
+            indices.resize(count);
+            for (size_t i = 0; i < count; i++)
+                indices[i] = static_cast<unsigned int>(i);
+        }
+        indices.resize(indices.size() / 3 * 3);
+
+        if (!normal)
+            GenerateSmoothNormals(vertices, indices);
+        if (tangent)
+        {
+            // the bitangent follows from the normal and the handedness in the tangent's w
+            const unsigned char *in = tangent->data;
+            size_t size = componentSize(tangent->componentType);
+            for (size_t i = 0; i < count; i++, in += tangent->stride)
+            {
+                float w = readComponent(in + 3 * size, tangent->componentType, tangent->normalized);
+                vertices[i].Bitangent = glm::cross(vertices[i].Normal, vertices[i].Tangent) * (w < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+        else if (texCoord && generateTangents)
+        {
+            GenerateTangents(vertices, indices);
+        }
+        return true;
+    }
+
+private:
+    struct BufferRange {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+    };
+
+    AssetFile file;
+    vector<unique_ptr<AssetFile> > externalBuffers;
+    JsonValue document;
+    vector<BufferRange> bufferRanges;
+    vector<gltf_detail::BufferView> bufferViews;
+    vector<gltf_detail::Accessor> accessors;
+    vector<GltfPrimitive> primitives;
+    vector<GltfImage> images;
+    vector<GltfMaterial> materials;
+
+    bool fail(const string &path, const string &reason)
+    {
+        cout << "ERROR::GLTF:: " << path << ": " << reason << endl;
+        Close();
+        return false;
+    }
+
+    // the accessor if it exists and has at least the given number of components
+    const gltf_detail::Accessor* accessor(int index, int components) const
+    {
+        if (index < 0 || static_cast<size_t>(index) >= accessors.size())
+            return nullptr;
+        const gltf_detail::Accessor &result = accessors[index];
+        return result.data && result.components >= components ? &result : nullptr;
+    }
+
+    void addNode(int index, int depth)
+    {
+        const JsonValue &node = document["nodes"][static_cast<size_t>(index)];
+        if (node.IsNull() || depth > 64)
+            return;
+        addMesh(node["mesh"].Int());
+        for (size_t i = 0; i < node["children"].Size(); i++)
+            addNode(node["children"][i].Int(), depth + 1);
+    }
+
+    void addMesh(int index)
+    {
+        const JsonValue &mesh = document["meshes"][static_cast<size_t>(index)];
+        for (size_t i = 0; i < mesh["primitives"].Size(); i++)
+        {
+            const JsonValue &primitive = mesh["primitives"][i];
+            // points and lines are skipped, Model only draws triangles
+            if (primitive["mode"].Int(GLTF_TRIANGLES) != GLTF_TRIANGLES)
+                continue;
+            const JsonValue &attributes = primitive["attributes"];
+            GltfPrimitive result;
+            result.position = attributes["POSITION"].Int();
+            result.normal = attributes["NORMAL"].Int();
+            result.texCoord = attributes["TEXCOORD_0"].Int();
+            result.tangent = attributes["TANGENT"].Int();
+            result.indices = primitive["indices"].Int();
+            result.material = primitive["material"].Int();
+            if (result.material >= static_cast<int>(materials.size()))
+                result.material = -1;
+            primitives.push_back(result);
+        }
+    }
+};
+#endif
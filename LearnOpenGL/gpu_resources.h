@@ -0,0 +1,185 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// Something holding GPU memory that can give it up and build it again the next time it's used, such as a Model
+// (see ModelLoadOptions::evictable).
+class EvictableResource
+{
+public:
+    virtual ~EvictableResource() {}
+    virtual string ResourceName() const = 0;
+    // frees the GPU memory. Returns false if that isn't possible right now, e.g. while still loading.
+    virtual bool Evict() = 0;
+};
+
+// bytes of a 2D texture with bytesPerTexel texels, including its mip chain down to 1x1 if mipmapped
+inline size_t TextureBytes2D(int width, int height, size_t bytesPerTexel, bool mipmapped)
+{
+    size_t bytes = 0;
+    while (true)
+    {
+        bytes += size_t(width) * height * bytesPerTexel;
+        if (!mipmapped || (width <= 1 && height <= 1))
+            return bytes;
+        width = max(width / 2, 1);
+        height = max(height / 2, 1);
+    }
+}
+
+// Accounts the GPU memory of the buffers and textures the loaders create, by GL name, and keeps it within a
+// budget by evicting whatever was drawn least recently:
+//   GpuResourceManager &resources = GpuResourceManager::Instance();
+//   resources.settings.budgetBytes = size_t(512) << 20;
+//   resources.Update();                    // once per frame, after drawing
+// Models register themselves once loaded and Touch() on every draw. An evicted model frees its meshes and drops
+// its texture references, and its next draw starts loading it again in the background: from the mesh cache and
+// the cooked textures, or from the source files if those are missing. The sizes are those of the data (plus mip
+// chains); drivers add padding.
+// All member functions must run on the GL context thread.
+class GpuResourceManager
+{
+public:
+    struct Settings {
+        // GPU memory all accounted buffers and textures may use together before anything is evicted
+        size_t budgetBytes = size_t(1) << 30;
+        // only what wasn't drawn for this many Update() calls is evicted, so what's on screen never is
+        unsigned int minIdleFrames = 1;
+    };
+
+    static GpuResourceManager& Instance()
+    {
+        static GpuResourceManager manager;
+        return manager;
+    }
+
+    Settings settings;
+
+    GpuResourceManager(const GpuResourceManager&) = delete;
+    GpuResourceManager& operator=(const GpuResourceManager&) = delete;
+
+    // sets the size of a buffer's data store, after every glBufferData
+    void BufferAllocated(unsigned int buffer, size_t bytes) { resize(buffers, bufferBytes, buffer, bytes); }
+    // before glDeleteBuffers
+    void BufferDeleted(unsigned int buffer) { forget(buffers, bufferBytes, buffer); }
+    // sets the size of all the levels a texture holds, after (re)specifying them
+    void TextureAllocated(unsigned int texture, size_t bytes) { resize(textures, textureBytes, texture, bytes); }
+    // before glDeleteTextures
+    void TextureDeleted(unsigned int texture) { forget(textures, textureBytes, texture); }
+
+    // makes a resource a candidate for eviction, as if drawn this frame. An evicted resource is forgotten and has to
+    // register again once it's rebuilt.
+    void Register(EvictableResource &resource)
+    {
+        if (lookup.find(&resource) != lookup.end())
+            return;
+        recent.push_front({ &resource, frame });
+        lookup[&resource] = recent.begin();
+    }
+
+    // before the resource is destroyed
+    void Unregister(EvictableResource &resource)
+    {
+        auto found = lookup.find(&resource);
+        if (found == lookup.end())
+            return;
+        recent.erase(found->second);
+        lookup.erase(found);
+    }
+
+    // the resource is drawn this frame. Does nothing for resources that aren't registered.
+    void Touch(EvictableResource &resource)
+    {
+        auto found = lookup.find(&resource);
+        if (found == lookup.end())
+            return;
+        found->second->lastUsed = frame;
+        recent.splice(recent.begin(), recent, found->second);
+    }
+
+    // evicts the least recently drawn resources until the accounted memory fits the budget, then starts a new frame.
+    void Update()
+    {
+        auto it = recent.end();
+        while (TotalBytes() > settings.budgetBytes && it != recent.begin())
+        {
+            --it;
+            // the list is ordered by last use, everything in front was drawn even more recently
+            if (frame - it->lastUsed < settings.minIdleFrames)
+                break;
+            EvictableResource *resource = it->resource;
+            size_t before = TotalBytes();
+            if (!resource->Evict())
+                continue;
+            lookup.erase(resource);
+            it = recent.erase(it);
+            evictions++;
+            cout << "GPU::EVICT:: " << resource->ResourceName() << ", " << (before - min(before, TotalBytes())) / 1024
+                << " KB freed, " << TotalBytes() / 1024 << " KB of " << settings.budgetBytes / 1024 << " KB in use" << endl;
+        }
+        frame++;
+    }
+
+    size_t BufferBytes() const { return bufferBytes; }
+    size_t TextureBytes() const { return textureBytes; }
+    size_t TotalBytes() const { return bufferBytes + textureBytes; }
+    size_t BufferCount() const { return buffers.size(); }
+    size_t TextureCount() const { return textures.size(); }
+    // registered resources, i.e. the ones eviction can pick from
+    size_t ResourceCount() const { return recent.size(); }
+    size_t Evictions() const { return evictions; }
+
+    void PrintStats() const
+    {
+        cout << "GPU::MEMORY:: " << buffers.size() << " buffers " << bufferBytes / 1024 << " KB, " << textures.size() << " textures "
+            << textureBytes / 1024 << " KB, budget " << settings.budgetBytes / 1024 << " KB, " << recent.size() << " evictable, "
+            << evictions << " evicted so far" << endl;
+    }
+
+private:
+    struct Use {
+        EvictableResource *resource;
+        uint64_t lastUsed;
+    };
+
+    unordered_map<unsigned int, size_t> buffers;	// GL name -> bytes
+    unordered_map<unsigned int, size_t> textures;
+    size_t bufferBytes = 0;
+    size_t textureBytes = 0;
+    // most recently drawn first
+    list<Use> recent;
+    unordered_map<EvictableResource*, list<Use>::iterator> lookup;
+    uint64_t frame = 0;
+    size_t evictions = 0;
+
+    GpuResourceManager() {}
+
+    static void resize(unordered_map<unsigned int, size_t> &sizes, size_t &total, unsigned int name, size_t bytes)
+    {
+        if (name == 0)
+            return;
+        size_t &size = sizes[name];
+        total = total - size + bytes;
+        size = bytes;
+    }
+
+    static void forget(unordered_map<unsigned int, size_t> &sizes, size_t &total, unsigned int name)
+    {
+        auto found = sizes.find(name);
+        if (found == sizes.end())
+            return;
+        total -= found->second;
+        sizes.erase(found);
+    }
+};
+#endif
@@ -0,0 +1,245 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_watcher.h"
+#include "model.h"
+#include "shader_s.h"
+#include "texture_loader.h"
+#include "texture_registry.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+using namespace std;
+
+// Rebuilds shaders, textures and models when their files change, while the app keeps rendering the old versions.
+//   HotReload hotReload;
+//   hotReload.WatchShader(ourShader);
+//   hotReload.WatchModel(ourModel);     // the model file and the image files of its textures
+//   hotReload.Update();                 // once per frame on the GL thread, before the models' Update()
+// Only what a changed file feeds is rebuilt: a shader source relinks that one program, an image is decoded (and
+// cooked) on the thread pool and re-uploaded into the same texture, so every mesh and model sharing it picks it up
+// without a rebind, and a model file re-imports that model alone (see Model::Reload). Whatever fails to reload
+// keeps its previous version. Shaders and models have to be unwatched before they are destroyed.
+class HotReload
+{
+public:
+    FileWatcher watcher;
+
+    void WatchShader(Shader &shader)
+    {
+        if (find(shaders.begin(), shaders.end(), &shader) != shaders.end())
+            return;
+        shaders.push_back(&shader);
+        watcher.Watch(shader.VertexPath());
+        watcher.Watch(shader.FragmentPath());
+    }
+
+    void UnwatchShader(Shader &shader)
+    {
+        shaders.erase(remove(shaders.begin(), shaders.end(), &shader), shaders.end());
+    }
+
+    // the model's textures are watched once it has loaded, and again after every reload
+    void WatchModel(Model &model)
+    {
+        for (const WatchedModel &watched : models)
+        {
+            if (watched.model == &model)
+                return;
+        }
+        models.push_back({ &model, 0 });
+        watcher.Watch(model.Path());
+    }
+
+    void UnwatchModel(Model &model)
+    {
+        models.erase(remove_if(models.begin(), models.end(), [&model](const WatchedModel &watched) { return watched.model == &model; }), models.end());
+    }
+
+    void Update()
+    {
+        for (WatchedModel &watched : models)
+        {
+            if (watched.revision != watched.model->Revision())
+            {
+                watched.revision = watched.model->Revision();
+                watchTextures(*watched.model);
+            }
+        }
+
+        vector<string> changed = watcher.Poll();
+        vector<Shader*> relink;
+        for (const string &path : changed)
+        {
+            for (Shader *shader : shaders)
+            {
+                if ((NormalizePath(shader->VertexPath()) == path || NormalizePath(shader->FragmentPath()) == path) &&
+                    find(relink.begin(), relink.end(), shader) == relink.end())
+                    relink.push_back(shader);
+            }
+            for (WatchedModel &watched : models)
+            {
+                if (NormalizePath(watched.model->Path()) == path)
+                {
+                    cout << "MODEL::RELOAD:: " << path << " changed, importing it again" << endl;
+                    watched.model->Reload();
+                }
+            }
+            if (textures.find(path) != textures.end())
+                startTexture(path);
+        }
+        for (Shader *shader : relink)
+        {
+            if (shader->Reload())
+                cout << "SHADER::RELOAD:: " << shader->VertexPath() << ", " << shader->FragmentPath() << endl;
+        }
+
+        for (auto it = textureJobs.begin(); it != textureJobs.end(); )
+        {
+            shared_ptr<TextureJob> job = it->second;
+            if (!job->done)
+            {
+                ++it;
+                continue;
+            }
+            it = textureJobs.erase(it);
+            if (job->restart)
+            {
+                // changed again while decoding, the result is outdated already
+                FreeDecodedImage(job->image);
+                startTexture(job->path);
+                continue;
+            }
+            finishTexture(*job);
+        }
+    }
+
+    // texture reloads still decoding
+    size_t PendingCount() const { return textureJobs.size(); }
+
+private:
+    struct WatchedModel {
+        Model *model;
+        unsigned int revision;
+    };
+
+    // how an image file was loaded, so it can be loaded again the same way
+    struct TextureSource {
+        Texture_Usage usage;
+        TextureCookSettings cook;
+    };
+
+    struct TextureJob {
+        string path;
+        TextureSource source;
+        TextureLevels levels;
+        DecodedImage image;
+        bool ok = false;
+        atomic<bool> done{ false };
+        // GL thread only
+        bool restart = false;
+    };
+
+    vector<Shader*> shaders;
+    vector<WatchedModel> models;
+    unordered_map<string, TextureSource> textures;	// normalized path -> source
+    unordered_map<string, shared_ptr<TextureJob> > textureJobs;	// normalized path -> reload in flight
+
+    void watchTextures(const Model &model)
+    {
+        TextureSource source;
+        source.cook = model.TextureCook();
+        // the stamps of cooked files only resolve whole seconds, always start from the changed image
+        source.cook.readCooked = false;
+        for (const Texture &texture : model.textures_loaded)
+        {
+            string path = imagePath(model, texture);
+            if (path.empty())
+                continue;
+            source.usage = texture.type == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR;
+            textures[path] = source;
+            watcher.Watch(path);
+        }
+    }
+
+    // the normalized path of a model texture's image file, empty for images embedded in the model file (they come
+    // with it)
+    static string imagePath(const Model &model, const Texture &texture)
+    {
+        if (texture.path.empty() || texture.path[0] == '*')
+            return string();
+        return NormalizePath(model.directory + '/' + texture.path);
+    }
+
+    void startTexture(const string &path)
+    {
+        auto running = textureJobs.find(path);
+        if (running != textureJobs.end())
+        {
+            running->second->restart = true;
+            return;
+        }
+        shared_ptr<TextureJob> job = make_shared<TextureJob>();
+        job->path = path;
+        job->source = textures[path];
+        textureJobs[path] = job;
+        ThreadPool::Shared().Enqueue([job]() {
+            job->ok = LoadOrCookTexture(job->path, job->source.usage, job->source.cook, job->levels, job->image);
+            job->done = true;
+        });
+    }
+
+    // GL thread: re-uploads a decoded image into the texture registered for its path, and into the texture array
+    // layers of the models that draw it from their arrays (they hold no 2D texture of it)
+    void finishTexture(TextureJob &job)
+    {
+        if (!job.ok)
+        {
+            cout << "ERROR::TEXTURE::RELOAD:: keeping the previous version of " << job.path << endl;
+            return;
+        }
+        bool packed = false;
+        for (WatchedModel &watched : models)
+        {
+            for (const Texture &texture : watched.model->textures_loaded)
+            {
+                if (imagePath(*watched.model, texture) == job.path && watched.model->TextureChanged(texture.path, job.levels, job.image))
+                    packed = true;
+            }
+        }
+        unsigned int id = TextureRegistry::Instance().Find(job.path);
+        // released meanwhile (or only packed), nothing else to update
+        if (id == 0)
+        {
+            FreeDecodedImage(job.image);
+            if (packed)
+                cout << "TEXTURE::RELOAD:: " << job.path << endl;
+            return;
+        }
+        TextureStreamer &streamer = TextureStreamer::Instance();
+        if (job.levels.codec != CODEC_NONE)
+        {
+            if (!streamer.Replace(id, move(job.levels)))
+                UploadTextureLevels2D(job.levels, id);
+        }
+        else
+        {
+            // plain pixels have no CPU side mip chain to stream from
+            streamer.Remove(id);
+            UploadTexture2D(job.image, id);
+            FreeDecodedImage(job.image);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        cout << "TEXTURE::RELOAD:: " << job.path << endl;
+    }
+};
+#endif
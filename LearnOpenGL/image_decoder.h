@@ -0,0 +1,277 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "stb_image.h"
+
+// Optimized backends are opt in, define these (in the project's preprocessor definitions) and link the library:
+//   IMAGE_DECODER_TURBOJPEG   JPEG through libjpeg-turbo's TurboJPEG API (turbojpeg.lib / -lturbojpeg)
+//   IMAGE_DECODER_SPNG        PNG through libspng (spng.lib / -lspng, which needs zlib or miniz)
+#ifdef IMAGE_DECODER_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifdef IMAGE_DECODER_SPNG
+#include <spng.h>
+#endif
+using namespace std;
+
+// pixels decoded on the CPU, waiting to be uploaded to the GPU.
+struct DecodedImage {
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+};
+
+// every decoder allocates the pixels with malloc, like stb_image does
+inline void FreeDecodedImage(DecodedImage &image)
+{
+    stbi_image_free(image.data);
+    image.data = nullptr;
+}
+
+enum Image_File_Format {
+    IMAGE_FILE_UNKNOWN,	// anything stb_image may still know: BMP, TGA, GIF, HDR, ...
+    IMAGE_FILE_JPEG,
+    IMAGE_FILE_PNG,
+    IMAGE_FILE_FORMAT_COUNT
+};
+
+// tells the format from the first bytes of the file rather than its extension
+inline Image_File_Format DetectImageFileFormat(const unsigned char *data, size_t size)
+{
+    static const unsigned char png[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+        return IMAGE_FILE_JPEG;
+    if (size >= 8 && memcmp(data, png, 8) == 0)
+        return IMAGE_FILE_PNG;
+    return IMAGE_FILE_UNKNOWN;
+}
+
+inline const char* ImageFileFormatName(Image_File_Format format)
+{
+    switch (format)
+    {
+    case IMAGE_FILE_JPEG: return "JPEG";
+    case IMAGE_FILE_PNG: return "PNG";
+    default: return "other";
+    }
+}
+
+// Turns an encoded image into 8 bit pixels with the channels of the file (1 to 4, what stbi_load returns for 0
+// desired channels), rows bottom up when flip is set. Decode() runs on the loader threads, so it must be thread
+// safe. Returning false hands the file to stb_image, a backend can turn down whatever it doesn't support.
+class ImageDecoder
+{
+public:
+    virtual ~ImageDecoder() {}
+    virtual const char* Name() const = 0;
+    virtual bool Decode(const unsigned char *data, size_t size, bool flip, DecodedImage &image) = 0;
+};
+
+class StbImageDecoder : public ImageDecoder
+{
+public:
+    const char* Name() const override { return "stb_image"; }
+
+    bool Decode(const unsigned char *data, size_t size, bool flip, DecodedImage &image) override
+    {
+        // the per thread flag overrides the global one stbi_set_flip_vertically_on_load sets
+        stbi_set_flip_vertically_on_load_thread(flip ? 1 : 0);
+        image.data = stbi_load_from_memory(data, static_cast<int>(size), &image.width, &image.height, &image.components, 0);
+        return image.data != nullptr;
+    }
+};
+
+#ifdef IMAGE_DECODER_TURBOJPEG
+// libjpeg-turbo's SIMD decoder. CMYK files go to stb_image, which converts them the way the textures expect.
+class TurboJpegDecoder : public ImageDecoder
+{
+public:
+    const char* Name() const override { return "libjpeg-turbo"; }
+
+    bool Decode(const unsigned char *data, size_t size, bool flip, DecodedImage &image) override
+    {
+        // a handle holds the decoder state, one per thread instead of a lock
+        struct Handle {
+            tjhandle handle = tjInitDecompress();
+            ~Handle() { if (handle) tjDestroy(handle); }
+        };
+        thread_local Handle decompressor;
+        if (!decompressor.handle)
+            return false;
+        int width = 0, height = 0, subsampling = 0, colorspace = 0;
+        if (tjDecompressHeader3(decompressor.handle, data, static_cast<unsigned long>(size), &width, &height, &subsampling, &colorspace) != 0)
+            return false;
+        if (colorspace == TJCS_CMYK || colorspace == TJCS_YCCK)
+            return false;
+        int components = colorspace == TJCS_GRAY ? 1 : 3;
+        unsigned char *pixels = static_cast<unsigned char*>(malloc(size_t(width) * height * components));
+        if (!pixels)
+            return false;
+        int flags = TJFLAG_FASTDCT | (flip ? TJFLAG_BOTTOMUP : 0);
+        if (tjDecompress2(decompressor.handle, data, static_cast<unsigned long>(size), pixels, width, 0, height,
+            components == 1 ? TJPF_GRAY : TJPF_RGB, flags) != 0)
+        {
+            free(pixels);
+            return false;
+        }
+        image.data = pixels;
+        image.width = width;
+        image.height = height;
+        image.components = components;
+        return true;
+    }
+};
+#endif
+
+#ifdef IMAGE_DECODER_SPNG
+// libspng, decoding row by row straight into the (possibly flipped) destination rows. Interlaced files and 16 bit
+// grayscale go to stb_image: their rows don't arrive in order, and spng has no 8 bit gray output for the latter.
+class SpngDecoder : public ImageDecoder
+{
+public:
+    const char* Name() const override { return "libspng"; }
+
+    bool Decode(const unsigned char *data, size_t size, bool flip, DecodedImage &image) override
+    {
+        spng_ctx *context = spng_ctx_new(0);
+        if (!context)
+            return false;
+        bool ok = decode(context, data, size, flip, image);
+        spng_ctx_free(context);
+        return ok;
+    }
+
+private:
+    static bool decode(spng_ctx *context, const unsigned char *data, size_t size, bool flip, DecodedImage &image)
+    {
+        spng_ihdr header;
+        if (spng_set_png_buffer(context, data, size) != 0 || spng_get_ihdr(context, &header) != 0 || header.interlace_method != 0)
+            return false;
+        // the channels stb_image would return: a tRNS chunk adds alpha
+        spng_trns transparency;
+        bool alpha = spng_get_trns(context, &transparency) == 0;
+        int components;
+        int format;
+        if ((header.color_type == SPNG_COLOR_TYPE_GRAYSCALE || header.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA) && header.bit_depth > 8)
+            return false;
+        switch (header.color_type)
+        {
+        case SPNG_COLOR_TYPE_GRAYSCALE:
+            components = alpha ? 2 : 1;
+            format = alpha ? SPNG_FMT_GA8 : SPNG_FMT_G8;
+            break;
+        case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA:
+            components = 2;
+            format = SPNG_FMT_GA8;
+            break;
+        case SPNG_COLOR_TYPE_TRUECOLOR_ALPHA:
+            components = 4;
+            format = SPNG_FMT_RGBA8;
+            break;
+        default:
+            components = alpha ? 4 : 3;
+            format = alpha ? SPNG_FMT_RGBA8 : SPNG_FMT_RGB8;
+            break;
+        }
+
+        size_t stride = size_t(header.width) * components;
+        unsigned char *pixels = static_cast<unsigned char*>(malloc(stride * header.height));
+        if (!pixels)
+            return false;
+        int result = spng_decode_image(context, nullptr, 0, format, SPNG_DECODE_TRNS | SPNG_DECODE_PROGRESSIVE);
+        while (result == 0)
+        {
+            spng_row_info row;
+            if (spng_get_row_info(context, &row) != 0)
+                break;
+            uint32_t target = flip ? header.height - 1 - row.row_num : row.row_num;
+            result = spng_decode_row(context, pixels + target * stride, stride);
+        }
+        if (result != SPNG_EOI)
+        {
+            free(pixels);
+            return false;
+        }
+        image.data = pixels;
+        image.width = static_cast<int>(header.width);
+        image.height = static_cast<int>(header.height);
+        image.components = components;
+        return true;
+    }
+};
+#endif
+
+// The decoder per file format, picked by the file's signature: the optimized backends that are compiled in, and
+// stb_image for every other format and whenever a backend turns a file down.
+//   ImageDecoders::Instance().SetFlipVertically(true);   // instead of stbi_set_flip_vertically_on_load
+//   ImageDecoders::Instance().Decode(data, size, image);  // what DecodeImageMemory / DecodeImageFile use
+// Set() replaces a format's backend; call it before any loading starts.
+class ImageDecoders
+{
+public:
+    static ImageDecoders& Instance()
+    {
+        static ImageDecoders decoders;
+        return decoders;
+    }
+
+    ImageDecoders(const ImageDecoders&) = delete;
+    ImageDecoders& operator=(const ImageDecoders&) = delete;
+
+    // nullptr goes back to stb_image
+    void Set(Image_File_Format format, ImageDecoder *decoder)
+    {
+        decoders[format] = decoder ? decoder : &stb;
+    }
+
+    ImageDecoder& For(Image_File_Format format) { return *decoders[format]; }
+    ImageDecoder& Fallback() { return stb; }
+
+    // flips every decoded image so the first row is the bottom one, what OpenGL's texture coordinates expect
+    void SetFlipVertically(bool flip)
+    {
+        flipVertically = flip;
+        stbi_set_flip_vertically_on_load(flip ? 1 : 0);
+    }
+    bool FlipVertically() const { return flipVertically; }
+
+    bool Decode(const unsigned char *data, size_t size, DecodedImage &image)
+    {
+        bool flip = flipVertically;
+        ImageDecoder &decoder = For(DetectImageFileFormat(data, size));
+        if (decoder.Decode(data, size, flip, image))
+            return true;
+        return &decoder != &stb && stb.Decode(data, size, flip, image);
+    }
+
+private:
+    StbImageDecoder stb;
+#ifdef IMAGE_DECODER_TURBOJPEG
+    TurboJpegDecoder turboJpeg;
+#endif
+#ifdef IMAGE_DECODER_SPNG
+    SpngDecoder spng;
+#endif
+    ImageDecoder *decoders[IMAGE_FILE_FORMAT_COUNT];
+    atomic<bool> flipVertically{ false };
+
+    ImageDecoders()
+    {
+        for (ImageDecoder *&decoder : decoders)
+            decoder = &stb;
+#ifdef IMAGE_DECODER_TURBOJPEG
+        decoders[IMAGE_FILE_JPEG] = &turboJpeg;
+#endif
+#ifdef IMAGE_DECODER_SPNG
+        decoders[IMAGE_FILE_PNG] = &spng;
+#endif
+    }
+};
+#endif
@@ -0,0 +1,39 @@
+#version 410 core
+// vertex shader for meshes uploaded with the PackedVertex layout (see mesh.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aNormalOct;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangentOct;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+out mat3 TBN;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// inverse of OctahedralEncode() in mesh.h
+vec3 octDecode(vec2 oct)
+{
+    vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 normal = octDecode(aNormalOct);
+    // tangent frame for normal mapping: the bitangent is rebuilt from its stored sign
+    vec3 tangent = octDecode(aTangentOct.xy);
+    vec3 bitangent = cross(normal, tangent) * aTangentOct.w;
+    mat3 normalMatrix = mat3(transpose(inverse(model)));
+
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = normalMatrix * normal;
+    TexCoords = aTexCoords;
+    TBN = mat3(normalize(normalMatrix * tangent), normalize(normalMatrix * bitangent), normalize(Normal));
+}
@@ -5,11 +5,18 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "gpu_resources.h"
 #include "shader_s.h"
+#include "texture_array.h"
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
@@ -31,39 +38,581 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// Compact vertex layout (24 bytes instead of 88), used with lighting_packed.vert:
+// normal and tangent are octahedral encoded, the bitangent is rebuilt in the shader from
+// cross(normal, tangent) and the sign stored in the tangent's w, texture coordinates are half floats.
+struct PackedVertex {
+    // position
+    glm::vec3 Position;
+    // octahedral normal, 2 x snorm16
+    uint32_t  Normal;
+    // octahedral tangent, 2 x snorm10 + bitangent sign in the 2 bit w (GL_INT_2_10_10_10_REV)
+    uint32_t  Tangent;
+    // texCoords, 2 x half float
+    uint32_t  TexCoords;
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must stay tightly packed");
+
+// bone data of a packed vertex, kept in its own buffer that only skinned meshes get.
+struct PackedBoneData {
+    // 16 bit, skeletons often have more than 256 bones
+    uint16_t BoneIDs[MAX_BONE_INFLUENCE];
+    // unorm8 weights
+    uint8_t  Weights[MAX_BONE_INFLUENCE];
+};
+
+static_assert(sizeof(PackedBoneData) == 12, "PackedBoneData must stay tightly packed");
+
+enum Vertex_Format {
+    FULL_VERTEX,
+    PACKED_VERTEX
+};
+
+// maps a unit vector onto the octahedron and unfolds it into the [-1, 1] square.
+inline glm::vec2 OctahedralEncode(glm::vec3 n)
+{
+    n /= (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+    glm::vec2 oct(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        oct.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        oct.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return oct;
+}
+
+inline PackedVertex PackVertex(const Vertex &vertex)
+{
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+
+    bool hasNormal = glm::dot(vertex.Normal, vertex.Normal) > 0.0f;
+    packed.Normal = glm::packSnorm2x16(hasNormal ? OctahedralEncode(vertex.Normal) : glm::vec2(0.0f, 0.0f));
+
+    bool hasTangent = glm::dot(vertex.Tangent, vertex.Tangent) > 0.0f;
+    glm::vec2 tangent = hasTangent ? OctahedralEncode(vertex.Tangent) : glm::vec2(0.0f, 0.0f);
+    float bitangentSign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent.x, tangent.y, 0.0f, bitangentSign));
+
+    packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+    return packed;
+}
+
+inline PackedBoneData PackBoneData(const Vertex &vertex)
+{
+    PackedBoneData packed;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        bool used = vertex.m_BoneIDs[i] >= 0 && vertex.m_Weights[i] > 0.0f;
+        packed.BoneIDs[i] = used ? static_cast<uint16_t>(vertex.m_BoneIDs[i]) : 0;
+        packed.Weights[i] = used ? static_cast<uint8_t>(glm::clamp(vertex.m_Weights[i], 0.0f, 1.0f) * 255.0f + 0.5f) : 0;
+    }
+    return packed;
+}
+
+// resets the bone influences of a vertex to "not skinned".
+inline void SetVertexBoneDataToDefault(Vertex &vertex)
+{
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        vertex.m_BoneIDs[i] = -1;
+        vertex.m_Weights[i] = 0.0f;
+    }
+}
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// where the first texture of each type a mesh has lives in its model's TextureArraySet
+// (ModelLoadOptions::textureArrays), array -1 for the types it has none of.
+struct MaterialLayers {
+    TextureLayer diffuse;
+    TextureLayer specular;
+    TextureLayer normal;
+    TextureLayer height;
+};
+
+// post-transform vertex cache efficiency of an index buffer, see AnalyzeVertexCache in mesh_optimizer.h.
+struct VertexCacheStats {
+    // average cache miss ratio: transformed vertices per triangle
+    float acmr = 0.0f;
+    // average transform to vertex ratio: transformed vertices per referenced vertex
+    float atvr = 0.0f;
+};
+
+struct MeshOptimizeStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    bool optimized = false;
+};
+
+// one level of detail: a range of the mesh's index buffer. error is the largest distance (in model units)
+// the simplified surface may deviate from the full resolution one.
+struct LodLevel {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    error;
+};
+
+// CPU side data of a mesh, as produced by the importer before it's uploaded.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures;
+    // filled in by OptimizeMesh at import time and kept in the mesh cache
+    MeshOptimizeStats    optimizeStats;
+    // levels of detail stored back to back in indices, empty if there's only the full resolution
+    vector<LodLevel>     lods;
+    // bounding sphere in model space
+    glm::vec3            boundsCenter = glm::vec3(0.0f);
+    float                boundsRadius = 0.0f;
+};
+
+// bounding sphere around the center of the axis aligned bounds of the vertices.
+inline void ComputeMeshBounds(MeshData &mesh)
+{
+    if (mesh.vertices.empty())
+        return;
+    glm::vec3 low = mesh.vertices[0].Position, high = low;
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        low = glm::min(low, vertex.Position);
+        high = glm::max(high, vertex.Position);
+    }
+    mesh.boundsCenter = (low + high) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        glm::vec3 offset = vertex.Position - mesh.boundsCenter;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    mesh.boundsRadius = std::sqrt(radiusSquared);
+}
+
+// per vertex normals for meshes that come without: the normals of the faces around each position (vertices
+// with identical positions count as one) averaged, like aiProcess_GenSmoothNormals.
+inline void GenerateSmoothNormals(vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+    vector<glm::vec3> sums(vertices.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const glm::vec3 &a = vertices[indices[i]].Position, &b = vertices[indices[i + 1]].Position, &c = vertices[indices[i + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        for (int k = 0; k < 3; k++)
+            sums[indices[i + k]] += normal / length;
+    }
+    // merge the sums of vertices that share a position
+    vector<unsigned int> order(vertices.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<unsigned int>(i);
+    auto less = [&vertices](unsigned int a, unsigned int b) {
+        const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    sort(order.begin(), order.end(), less);
+    for (size_t first = 0; first < order.size(); )
+    {
+        size_t last = first + 1;
+        glm::vec3 sum = sums[order[first]];
+        for (; last < order.size() && vertices[order[last]].Position == vertices[order[first]].Position; last++)
+            sum += sums[order[last]];
+        float length = glm::length(sum);
+        glm::vec3 normal = length > 0.0f ? sum / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        for (size_t i = first; i < last; i++)
+            vertices[order[i]].Normal = normal;
+        first = last;
+    }
+}
+
+// tangents and bitangents like aiProcess_CalcTangentSpace: per face from the uv gradients, orthogonalized against
+// each corner's normal and averaged over the faces sharing a vertex.
+inline void GenerateTangents(vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+    for (Vertex &vertex : vertices)
+    {
+        vertex.Tangent = glm::vec3(0.0f);
+        vertex.Bitangent = glm::vec3(0.0f);
+    }
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const Vertex &a = vertices[indices[i]];
+        const Vertex &b = vertices[indices[i + 1]];
+        const Vertex &c = vertices[indices[i + 2]];
+        glm::vec3 v = b.Position - a.Position, w = c.Position - a.Position;
+        float sx = b.TexCoords.x - a.TexCoords.x, sy = b.TexCoords.y - a.TexCoords.y;
+        float tx = c.TexCoords.x - a.TexCoords.x, ty = c.TexCoords.y - a.TexCoords.y;
+        float direction = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+        if (sx * ty == sy * tx)
+        {
+            sx = 0.0f; sy = 1.0f;
+            tx = 1.0f; ty = 0.0f;
+        }
+        glm::vec3 tangent = (w * sy - v * ty) * direction;
+        glm::vec3 bitangent = (w * sx - v * tx) * direction;
+        for (int k = 0; k < 3; k++)
+        {
+            Vertex &vertex = vertices[indices[i + k]];
+            glm::vec3 localTangent = tangent - vertex.Normal * glm::dot(tangent, vertex.Normal);
+            glm::vec3 localBitangent = bitangent - vertex.Normal * glm::dot(bitangent, vertex.Normal);
+            float tangentLength = glm::length(localTangent), bitangentLength = glm::length(localBitangent);
+            if (tangentLength > 0.0f)
+                vertex.Tangent += localTangent / tangentLength;
+            if (bitangentLength > 0.0f)
+                vertex.Bitangent += localBitangent / bitangentLength;
+        }
+    }
+    for (Vertex &vertex : vertices)
+    {
+        float tangentLength = glm::length(vertex.Tangent), bitangentLength = glm::length(vertex.Bitangent);
+        if (tangentLength > 0.0f)
+            vertex.Tangent /= tangentLength;
+        if (bitangentLength > 0.0f)
+            vertex.Bitangent /= bitangentLength;
+    }
+}
+
+// true if any vertex has a tangent
+inline bool HasTangents(const vector<Vertex> &vertices)
+{
+    for (const Vertex &vertex : vertices)
+    {
+        if (vertex.Tangent != glm::vec3(0.0f))
+            return true;
+    }
+    return false;
+}
+
+// true if any vertex has bone weights
+inline bool HasBoneWeights(const Vertex *vertexData, size_t vertexCount)
+{
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        {
+            if (vertexData[i].m_BoneIDs[j] >= 0 && vertexData[i].m_Weights[j] > 0.0f)
+                return true;
+        }
+    }
+    return false;
+}
+
+inline size_t VertexStride(Vertex_Format format)
+{
+    return format == PACKED_VERTEX ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// a single PackedBoneData without influences, which packed meshes without bones read for every vertex. Created on
+// first use and kept as long as the GL context.
+inline unsigned int ZeroBoneBuffer()
+{
+    static unsigned int buffer = 0;
+    if (buffer == 0)
+    {
+        PackedBoneData none = {};
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(none), &none, GL_STATIC_DRAW);
+    }
+    return buffer;
+}
+
+// points the attributes of the bound VAO at a vertex buffer in the given format. boneVBO holds the
+// PackedBoneData of skinned meshes in the packed format and is ignored otherwise (0 = not skinned).
+inline void SetupVertexAttributes(Vertex_Format format, unsigned int VBO, unsigned int boneVBO = 0)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (format == FULL_VERTEX)
+    {
+        // set the vertex attribute pointers
+        // vertex Positions
+        glEnableVertexAttribArray(0);	
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);	
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);	
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		// ids
+		glEnableVertexAttribArray(5);
+		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+
+		// weights
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        return;
+    }
+
+    // same attribute locations as the full layout, minus the bitangent (4) which lighting_packed.vert rebuilds.
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+    // octahedral normals, normalized to [-1, 1]
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    // half float texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    // octahedral tangent + bitangent sign
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+
+    // without a bone stream the skinning shaders would see the generic values of 5 and 6, context state that is
+    // (0, 0, 0, 1) by default and moves the mesh with a bone. Instead every vertex reads the one zero influence of
+    // ZeroBoneBuffer(): a divisor no instance count reaches keeps all of them on element 0, so the mesh stays put.
+    unsigned int divisor = 0;
+    if (boneVBO == 0)
+    {
+        boneVBO = ZeroBoneBuffer();
+        divisor = UINT_MAX;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, boneVBO);
+    // ids
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_UNSIGNED_SHORT, sizeof(PackedBoneData), (void*)offsetof(PackedBoneData, BoneIDs));
+    glVertexAttribDivisor(5, divisor);
+    // weights
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedBoneData), (void*)offsetof(PackedBoneData, Weights));
+    glVertexAttribDivisor(6, divisor);
+}
+
+// the position-only layout read by depth passes: location 0, tightly packed vec3s.
+inline void SetupPositionAttribute(unsigned int positionVBO)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+}
+
+// converts vertices into the layout of the given format: the vertex buffer contents, the packed bone
+// stream (only for PACKED_VERTEX when withBones is set) and the position-only stream (if withPositions).
+struct ConvertedVertices {
+    vector<PackedVertex>   packed;
+    vector<PackedBoneData> bones;
+    vector<glm::vec3>      positions;
+};
+
+inline void ConvertVertices(const Vertex *vertexData, size_t vertexCount, Vertex_Format format, bool withBones, bool withPositions,
+    ConvertedVertices &converted)
+{
+    if (format == PACKED_VERTEX)
+    {
+        converted.packed.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            converted.packed[i] = PackVertex(vertexData[i]);
+        if (withBones)
+        {
+            converted.bones.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++)
+                converted.bones[i] = PackBoneData(vertexData[i]);
+        }
+    }
+    if (withPositions)
+    {
+        converted.positions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            converted.positions[i] = vertexData[i].Position;
+    }
+}
+
+// the part of a shared vertex/index buffer a mesh occupies, see GeometryArena in geometry_arena.h.
+struct GeometrySlice {
+    unsigned int VAO = 0;
+    unsigned int depthVAO = 0;
+    // added to every index, so the mesh keeps its own 0 based indices
+    int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    Vertex_Format format = FULL_VERTEX;
+    bool hasBones = false;
+};
+
+// A mesh owns its GL objects: it's move-only and deletes its buffers and vertex arrays when destroyed.
+// Meshes living in a GeometryArena own nothing, the arena frees their storage.
 class Mesh {
 public:
     // mesh Data
+    // CPU copy of the geometry, empty for meshes created from external memory or after ReleaseCpuData()
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int VAO = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    Vertex_Format format = FULL_VERTEX;
+    // true if any vertex has bone weights
+    bool hasBones = false;
+    // index ranges of the levels of detail, empty if the mesh only has its full resolution
+    vector<LodLevel>     lods;
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // VAO reading only the tightly packed position stream, 0 if the mesh was created without one.
+    // shares the index buffer with VAO.
+    unsigned int depthVAO = 0;
+    // where the mesh starts in its buffers. Both are 0 unless it lives in a shared GeometryArena,
+    // in which case VAO and depthVAO belong to the arena.
+    int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    // layers of the material maps, set once the model packed its textures into arrays
+    MaterialLayers layers;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // positionStream: also keep the positions in a separate 12 byte stride buffer for DrawDepth().
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Vertex_Format format = FULL_VERTEX,
+        bool positionStream = false)
+        : format(format)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        // the vectors are taken by value: callers handing over temporaries (std::move) avoid any copy
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), positionStream);
+    }
+
+    // constructor that uploads straight from memory owned by someone else (e.g. a memory mapped mesh cache).
+    // no CPU copy of the geometry is kept, so vertices and indices stay empty.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures,
+        Vertex_Format format = FULL_VERTEX, bool positionStream = false)
+        : format(format)
+    {
+        this->textures = std::move(textures);
+        setupMesh(vertexData, vertexCount, indexData, indexCount, positionStream);
+    }
+
+    // constructor for a mesh whose geometry was already added to a shared GeometryArena. Owns no buffers
+    // and keeps no CPU copy of the geometry.
+    Mesh(const GeometrySlice &slice, vector<Texture> textures)
+        : VAO(slice.VAO), vertexCount(slice.vertexCount), indexCount(slice.indexCount), format(slice.format), hasBones(slice.hasBones),
+          depthVAO(slice.depthVAO), baseVertex(slice.baseVertex), firstIndex(slice.firstIndex)
+    {
+        this->textures = std::move(textures);
+    }
+
+    ~Mesh()
+    {
+        deleteBuffers();
+    }
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Mesh& operator=(Mesh &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        deleteBuffers();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        lods = std::move(other.lods);
+        VAO = other.VAO;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        format = other.format;
+        hasBones = other.hasBones;
+        boundsCenter = other.boundsCenter;
+        boundsRadius = other.boundsRadius;
+        depthVAO = other.depthVAO;
+        baseVertex = other.baseVertex;
+        firstIndex = other.firstIndex;
+        layers = other.layers;
+        ownsBuffers = other.ownsBuffers;
+        VBO = other.VBO;
+        EBO = other.EBO;
+        boneVBO = other.boneVBO;
+        positionVBO = other.positionVBO;
+        // the moved from mesh must not delete what it handed over
+        other.ownsBuffers = false;
+        other.VAO = other.depthVAO = 0;
+        other.VBO = other.EBO = other.boneVBO = other.positionVBO = 0;
+        other.vertexCount = other.indexCount = 0;
+        return *this;
+    }
+
+    // frees the CPU copy of the geometry once it lives on the GPU. Counts, bounds and LOD ranges are kept.
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    unsigned int LodCount() const { return lods.empty() ? 1 : static_cast<unsigned int>(lods.size()); }
+
+    // picks the coarsest level whose error stays below maxPixelError when one model unit covers pixelsPerUnit pixels.
+    unsigned int SelectLod(float pixelsPerUnit, float maxPixelError) const
+    {
+        unsigned int lod = 0;
+        for (unsigned int i = 1; i < lods.size(); i++)
+        {
+            if (lods[i].error * pixelsPerUnit <= maxPixelError)
+                lod = i;
+        }
+        return lod;
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // render the mesh, at the given level of detail
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         GLenum err = glGetError();
         if (err != GL_NO_ERROR) {
             std::cerr << "OpenGL error: " << err << std::endl;
         }
         glBindVertexArray(VAO);
+        BindTextures(shader);
+        
+        // draw mesh
+        err = glGetError();
+        if (err != GL_NO_ERROR) {
+            std::cerr << "OpenGL error: " << err << std::endl;
+        }
+        DrawElements(lod);
+        glBindVertexArray(0);
+        err = glGetError();
+        if (err != GL_NO_ERROR) {
+            std::cerr << "OpenGL error: " << err << std::endl;
+        }
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render positions only, for depth prepasses, shadow maps and occlusion queries. No textures are bound,
+    // the shader only gets location 0. Reads the packed position stream when the mesh has one.
+    void DrawDepth(unsigned int lod = 0)
+    {
+        glBindVertexArray(DepthVAO());
+        DrawElements(lod);
+        glBindVertexArray(0);
+    }
+
+    unsigned int DepthVAO() const { return depthVAO != 0 ? depthVAO : VAO; }
+
+    // binds the mesh's textures to consecutive units and points the shader's samplers at them.
+    void BindTextures(Shader &shader)
+    {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
@@ -89,70 +638,120 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-        
-        // draw mesh
-        err = glGetError();
-        if (err != GL_NO_ERROR) {
-            std::cerr << "OpenGL error: " << err << std::endl;
-        }
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        err = glGetError();
-        if (err != GL_NO_ERROR) {
-            std::cerr << "OpenGL error: " << err << std::endl;
-        }
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // points the shader's diffuseLayer, specularLayer, normalLayer and heightLayer (array, layer) at the mesh's layers,
+    // the array texture counterpart of BindTextures: the arrays themselves are bound once (TextureArraySet::Bind).
+    void BindTextureLayers(Shader &shader) const
+    {
+        const pair<const char*, const TextureLayer*> uniforms[] = {
+            { "diffuseLayer", &layers.diffuse }, { "specularLayer", &layers.specular },
+            { "normalLayer", &layers.normal }, { "heightLayer", &layers.height } };
+        for (const auto &uniform : uniforms)
+            glUniform2i(glGetUniformLocation(shader.ID, uniform.first), uniform.second->array, uniform.second->layer);
+    }
+
+    // issues the draw call for one level of detail. Expects VAO (or the depth VAO) to be bound already,
+    // so consecutive meshes sharing an arena don't have to rebind it.
+    void DrawElements(unsigned int lod = 0)
+    {
+        unsigned int first = firstIndex, count = indexCount;
+        if (!lods.empty())
+        {
+            const LodLevel &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+            first += level.firstIndex;
+            count = level.indexCount;
+        }
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(count), GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)), baseVertex);
     }
 
 private:
+    // false for meshes in a GeometryArena and for moved from meshes
+    bool ownsBuffers = false;
     // render data 
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0;
+    // packed bone data, only created for skinned meshes in the packed format
+    unsigned int boneVBO = 0;
+    // positions only, backs depthVAO
+    unsigned int positionVBO = 0;
+
+    void deleteBuffers()
+    {
+        if (!ownsBuffers)
+            return;
+        if (VAO != 0)
+            glDeleteVertexArrays(1, &VAO);
+        if (depthVAO != 0)
+            glDeleteVertexArrays(1, &depthVAO);
+        unsigned int buffers[] = { VBO, EBO, boneVBO, positionVBO };
+        for (unsigned int buffer : buffers)
+        {
+            if (buffer != 0)
+            {
+                GpuResourceManager::Instance().BufferDeleted(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+        VAO = depthVAO = 0;
+        VBO = EBO = boneVBO = positionVBO = 0;
+        ownsBuffers = false;
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, bool positionStream)
     {
+        ownsBuffers = true;
+        this->vertexCount = static_cast<unsigned int>(vertexCount);
+        this->indexCount = static_cast<unsigned int>(indexCount);
+        hasBones = HasBoneWeights(vertexData, vertexCount);
+        ConvertedVertices converted;
+        ConvertVertices(vertexData, vertexCount, format, hasBones, positionStream, converted);
+        GpuResourceManager &resources = GpuResourceManager::Instance();
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+        resources.BufferAllocated(EBO, indexCount * sizeof(unsigned int));
+
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        if (format == PACKED_VERTEX)
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), converted.packed.data(), GL_STATIC_DRAW);
+        else
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+        resources.BufferAllocated(VBO, vertexCount * VertexStride(format));
+        if (!converted.bones.empty())
+        {
+            glGenBuffers(1, &boneVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, boneVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedBoneData), converted.bones.data(), GL_STATIC_DRAW);
+            resources.BufferAllocated(boneVBO, vertexCount * sizeof(PackedBoneData));
+        }
+        SetupVertexAttributes(format, VBO, boneVBO);
         glBindVertexArray(0);
+
+        // a second VAO over a tightly packed copy of the positions, so depth only passes fetch 12 bytes per
+        // vertex instead of the whole interleaved vertex. The element buffer is shared with the main VAO.
+        if (positionStream)
+        {
+            glGenVertexArrays(1, &depthVAO);
+            glGenBuffers(1, &positionVBO);
+            glBindVertexArray(depthVAO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), converted.positions.data(), GL_STATIC_DRAW);
+            resources.BufferAllocated(positionVBO, vertexCount * sizeof(glm::vec3));
+            SetupPositionAttribute(positionVBO);
+            glBindVertexArray(0);
+        }
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,387 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "asset_archive.h"
+#include "file_utils.h"
+#include "mesh.h"
+#include "skinning.h"
+using namespace std;
+
+// bump whenever the layout below or the Vertex struct changes so old caches are rebuilt.
+#define MESH_CACHE_VERSION 7
+
+// Binary layout of a .meshcache file. The header and the record tables follow each other without padding; each
+// mesh's vertex and index arrays start 16 byte aligned:
+//   MeshCacheHeader
+//   MeshCacheMeshRecord[meshCount]
+//   MeshCacheTextureRecord[textureCount]
+//   MeshCacheLodRecord[lodCount]
+//   MeshCacheBoneRecord[boneCount], the model's bone table that the vertices' m_BoneIDs index
+//   per mesh: Vertex[vertexCount], unsigned int[indexCount]
+// buildFlags record which optional processing (MESH_BUILD_*) went into the stored geometry, overdrawThreshold
+// the ACMR growth the overdraw optimization was allowed and lodMaxError where LOD simplification stopped (each 0
+// if that step didn't run).
+// The vertex and index arrays are stored exactly as Mesh::setupMesh uploads them, so a mapped
+// cache can be handed to glBufferData without any conversion.
+struct MeshCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t buildFlags;
+    uint32_t lodCount;
+    uint32_t boneCount;
+    uint64_t sourceMtime;
+    uint64_t sourceSize;
+    uint64_t pathHash;
+    float    overdrawThreshold;
+    float    lodMaxError;
+};
+
+struct MeshCacheMeshRecord {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    // vertex cache statistics of the import time optimizer, zero if the mesh wasn't optimized
+    float    acmrBefore;
+    float    atvrBefore;
+    float    acmrAfter;
+    float    atvrAfter;
+    // levels of detail (index ranges of this mesh's index array), lodCount is 0 without LODs
+    uint32_t firstLod;
+    uint32_t lodCount;
+    // bounding sphere
+    float    boundsCenter[3];
+    float    boundsRadius;
+};
+
+struct MeshCacheTextureRecord {
+    char type[32];
+    char path[224];
+};
+
+struct MeshCacheLodRecord {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    error;
+    uint32_t reserved;
+};
+
+struct MeshCacheBoneRecord {
+    char  name[112];
+    // BoneInfo::offset, column major
+    float offset[16];
+};
+
+static_assert(sizeof(MeshCacheHeader) == 72, "mesh cache header must not contain padding");
+static_assert(sizeof(MeshCacheMeshRecord) == 72, "mesh cache record must not contain padding");
+static_assert(sizeof(MeshCacheLodRecord) == 16, "mesh cache lod record must not contain padding");
+static_assert(sizeof(MeshCacheBoneRecord) == 176, "mesh cache bone record must not contain padding");
+
+// post processing applied on top of the Assimp import
+#define MESH_BUILD_VERTEX_CACHE 0x1
+#define MESH_BUILD_OVERDRAW     0x2
+#define MESH_BUILD_LODS         0x4
+// imported by the native OBJ loader (obj_loader.h) instead of Assimp
+#define MESH_BUILD_NATIVE_OBJ   0x8
+// imported by the native glTF loader (gltf_loader.h)
+#define MESH_BUILD_NATIVE_GLTF  0x10
+// tangents only for meshes with a normal map
+#define MESH_BUILD_NORMAL_MAP_TANGENTS 0x20
+
+// everything a cache has to match to be considered fresh.
+struct MeshCacheKey {
+    uint32_t importFlags = 0;
+    uint32_t buildFlags = 0;
+    FileStamp source;
+    uint64_t pathHash = 0;
+    // set by the caller when MESH_BUILD_OVERDRAW is in buildFlags
+    float overdrawThreshold = 0.0f;
+    // set by the caller when MESH_BUILD_LODS is in buildFlags
+    float lodMaxError = 0.0f;
+};
+
+class MeshCache
+{
+public:
+    static string CachePathFor(const string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    static bool MakeKey(const string &sourcePath, unsigned int importFlags, unsigned int buildFlags, MeshCacheKey &key)
+    {
+        if (!GetAssetStamp(sourcePath, key.source))
+            return false;
+        key.importFlags = importFlags;
+        key.buildFlags = buildFlags;
+        key.pathHash = HashString(sourcePath);
+        return true;
+    }
+
+    // maps the cache file and validates it against the key. The returned pointers stay valid until Close().
+    bool Open(const string &cachePath, const MeshCacheKey &key)
+    {
+        if (!file.Open(cachePath))
+            return false;
+        if (file.Size() < sizeof(MeshCacheHeader))
+            return fail();
+
+        header = reinterpret_cast<const MeshCacheHeader*>(file.Data());
+        if (memcmp(header->magic, "LOGLMESH", 8) != 0 || header->version != MESH_CACHE_VERSION ||
+            header->vertexStride != sizeof(Vertex) || header->importFlags != key.importFlags ||
+            header->buildFlags != key.buildFlags || header->overdrawThreshold != key.overdrawThreshold ||
+            header->lodMaxError != key.lodMaxError ||
+            header->sourceMtime != key.source.mtime || header->sourceSize != key.source.size ||
+            header->pathHash != key.pathHash)
+            return fail();
+
+        size_t tableEnd = sizeof(MeshCacheHeader) + header->meshCount * sizeof(MeshCacheMeshRecord) +
+            header->textureCount * sizeof(MeshCacheTextureRecord) + header->lodCount * sizeof(MeshCacheLodRecord) +
+            header->boneCount * sizeof(MeshCacheBoneRecord);
+        if (tableEnd > file.Size())
+            return fail();
+        meshes = reinterpret_cast<const MeshCacheMeshRecord*>(file.Data() + sizeof(MeshCacheHeader));
+        textures = reinterpret_cast<const MeshCacheTextureRecord*>(meshes + header->meshCount);
+        lods = reinterpret_cast<const MeshCacheLodRecord*>(textures + header->textureCount);
+        bones = reinterpret_cast<const MeshCacheBoneRecord*>(lods + header->lodCount);
+
+        // make sure no record points outside of the file before anyone dereferences it
+        for (unsigned int i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheMeshRecord &mesh = meshes[i];
+            if (mesh.vertexOffset + uint64_t(mesh.vertexCount) * sizeof(Vertex) > file.Size() ||
+                mesh.indexOffset + uint64_t(mesh.indexCount) * sizeof(unsigned int) > file.Size() ||
+                mesh.firstTexture + mesh.textureCount > header->textureCount ||
+                mesh.firstLod + mesh.lodCount > header->lodCount)
+                return fail();
+            for (unsigned int l = 0; l < mesh.lodCount; l++)
+            {
+                const MeshCacheLodRecord &lod = lods[mesh.firstLod + l];
+                if (uint64_t(lod.firstIndex) + lod.indexCount > mesh.indexCount)
+                    return fail();
+            }
+        }
+        // the texture names are fixed size fields, each must be terminated inside its field
+        for (unsigned int i = 0; i < header->textureCount; i++)
+        {
+            const MeshCacheTextureRecord &texture = textures[i];
+            if (!memchr(texture.type, '\0', sizeof(texture.type)) || !memchr(texture.path, '\0', sizeof(texture.path)))
+                return fail();
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        header = nullptr;
+        meshes = nullptr;
+        textures = nullptr;
+        lods = nullptr;
+        bones = nullptr;
+    }
+
+    unsigned int MeshCount() const { return header ? header->meshCount : 0; }
+    const MeshCacheMeshRecord& MeshRecord(unsigned int mesh) const { return meshes[mesh]; }
+    const Vertex* Vertices(unsigned int mesh) const
+    {
+        return reinterpret_cast<const Vertex*>(file.Data() + meshes[mesh].vertexOffset);
+    }
+    const unsigned int* Indices(unsigned int mesh) const
+    {
+        return reinterpret_cast<const unsigned int*>(file.Data() + meshes[mesh].indexOffset);
+    }
+    const MeshCacheTextureRecord& TextureRecord(unsigned int texture) const { return textures[texture]; }
+
+    // the stored bone table, empty for models without skinned meshes
+    void GetBones(vector<BoneInfo> &boneTable) const
+    {
+        boneTable.resize(header->boneCount);
+        for (unsigned int i = 0; i < header->boneCount; i++)
+        {
+            const MeshCacheBoneRecord &record = bones[i];
+            boneTable[i].name.assign(record.name, strnlen(record.name, sizeof(record.name)));
+            memcpy(&boneTable[i].offset[0][0], record.offset, sizeof(record.offset));
+        }
+    }
+
+    // copies the levels of detail and bounds of a mesh into data.
+    void GetLods(unsigned int mesh, MeshData &data) const
+    {
+        const MeshCacheMeshRecord &record = meshes[mesh];
+        data.lods.clear();
+        for (unsigned int l = 0; l < record.lodCount; l++)
+        {
+            const MeshCacheLodRecord &lod = lods[record.firstLod + l];
+            data.lods.push_back({ lod.firstIndex, lod.indexCount, lod.error });
+        }
+        data.boundsCenter = glm::vec3(record.boundsCenter[0], record.boundsCenter[1], record.boundsCenter[2]);
+        data.boundsRadius = record.boundsRadius;
+    }
+
+    MeshOptimizeStats OptimizeStats(unsigned int mesh) const
+    {
+        MeshOptimizeStats stats;
+        stats.before.acmr = meshes[mesh].acmrBefore;
+        stats.before.atvr = meshes[mesh].atvrBefore;
+        stats.after.acmr = meshes[mesh].acmrAfter;
+        stats.after.atvr = meshes[mesh].atvrAfter;
+        stats.optimized = (header->buildFlags & MESH_BUILD_VERTEX_CACHE) != 0;
+        return stats;
+    }
+
+    // serializes the converted meshes and the bone table. Returns false (and writes nothing) if a mesh has no
+    // geometry or a texture reference or bone name doesn't fit into the fixed size record.
+    static bool Write(const string &cachePath, const MeshCacheKey &key, const vector<const MeshData*> &sourceMeshes,
+        const vector<BoneInfo> &boneTable = vector<BoneInfo>())
+    {
+        MeshCacheHeader head;
+        memset(&head, 0, sizeof(head));
+        memcpy(head.magic, "LOGLMESH", 8);
+        head.version = MESH_CACHE_VERSION;
+        head.vertexStride = sizeof(Vertex);
+        head.importFlags = key.importFlags;
+        head.buildFlags = key.buildFlags;
+        head.meshCount = static_cast<uint32_t>(sourceMeshes.size());
+        head.sourceMtime = key.source.mtime;
+        head.sourceSize = key.source.size;
+        head.pathHash = key.pathHash;
+        head.overdrawThreshold = key.overdrawThreshold;
+        head.lodMaxError = key.lodMaxError;
+
+        vector<MeshCacheMeshRecord> records(sourceMeshes.size());
+        vector<MeshCacheTextureRecord> textureRecords;
+        vector<MeshCacheLodRecord> lodRecords;
+        for (size_t i = 0; i < sourceMeshes.size(); i++)
+        {
+            const MeshData &mesh = *sourceMeshes[i];
+            if (mesh.vertices.empty() || mesh.indices.empty())
+                return false;
+            records[i].vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            records[i].indexCount = static_cast<uint32_t>(mesh.indices.size());
+            records[i].firstTexture = static_cast<uint32_t>(textureRecords.size());
+            records[i].textureCount = static_cast<uint32_t>(mesh.textures.size());
+            records[i].acmrBefore = mesh.optimizeStats.before.acmr;
+            records[i].atvrBefore = mesh.optimizeStats.before.atvr;
+            records[i].acmrAfter = mesh.optimizeStats.after.acmr;
+            records[i].atvrAfter = mesh.optimizeStats.after.atvr;
+            records[i].firstLod = static_cast<uint32_t>(lodRecords.size());
+            records[i].lodCount = static_cast<uint32_t>(mesh.lods.size());
+            records[i].boundsCenter[0] = mesh.boundsCenter.x;
+            records[i].boundsCenter[1] = mesh.boundsCenter.y;
+            records[i].boundsCenter[2] = mesh.boundsCenter.z;
+            records[i].boundsRadius = mesh.boundsRadius;
+            for (const LodLevel &lod : mesh.lods)
+            {
+                MeshCacheLodRecord record = { lod.firstIndex, lod.indexCount, lod.error, 0 };
+                lodRecords.push_back(record);
+            }
+            for (const Texture &texture : mesh.textures)
+            {
+                MeshCacheTextureRecord record;
+                memset(&record, 0, sizeof(record));
+                if (texture.type.size() >= sizeof(record.type) || texture.path.size() >= sizeof(record.path))
+                    return false;
+                memcpy(record.type, texture.type.data(), texture.type.size());
+                memcpy(record.path, texture.path.data(), texture.path.size());
+                textureRecords.push_back(record);
+            }
+        }
+        head.textureCount = static_cast<uint32_t>(textureRecords.size());
+        head.lodCount = static_cast<uint32_t>(lodRecords.size());
+
+        vector<MeshCacheBoneRecord> boneRecords(boneTable.size());
+        for (size_t i = 0; i < boneTable.size(); i++)
+        {
+            MeshCacheBoneRecord &record = boneRecords[i];
+            memset(&record, 0, sizeof(record));
+            if (boneTable[i].name.size() >= sizeof(record.name))
+                return false;
+            memcpy(record.name, boneTable[i].name.data(), boneTable[i].name.size());
+            memcpy(record.offset, &boneTable[i].offset[0][0], sizeof(record.offset));
+        }
+        head.boneCount = static_cast<uint32_t>(boneRecords.size());
+
+        // lay out the geometry blobs behind the tables
+        uint64_t offset = align(sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheMeshRecord) +
+            textureRecords.size() * sizeof(MeshCacheTextureRecord) + lodRecords.size() * sizeof(MeshCacheLodRecord) +
+            boneRecords.size() * sizeof(MeshCacheBoneRecord));
+        for (size_t i = 0; i < sourceMeshes.size(); i++)
+        {
+            records[i].vertexOffset = offset;
+            offset = align(offset + records[i].vertexCount * sizeof(Vertex));
+            records[i].indexOffset = offset;
+            offset = align(offset + records[i].indexCount * sizeof(unsigned int));
+        }
+
+        // write to a temporary file first so a crash never leaves a truncated cache behind
+        string tempPath = cachePath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+            out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(MeshCacheMeshRecord));
+            out.write(reinterpret_cast<const char*>(textureRecords.data()), textureRecords.size() * sizeof(MeshCacheTextureRecord));
+            out.write(reinterpret_cast<const char*>(lodRecords.data()), lodRecords.size() * sizeof(MeshCacheLodRecord));
+            out.write(reinterpret_cast<const char*>(boneRecords.data()), boneRecords.size() * sizeof(MeshCacheBoneRecord));
+            for (size_t i = 0; i < sourceMeshes.size(); i++)
+            {
+                pad(out, records[i].vertexOffset);
+                out.write(reinterpret_cast<const char*>(sourceMeshes[i]->vertices.data()), records[i].vertexCount * sizeof(Vertex));
+                pad(out, records[i].indexOffset);
+                out.write(reinterpret_cast<const char*>(sourceMeshes[i]->indices.data()), records[i].indexCount * sizeof(unsigned int));
+            }
+            if (!out)
+            {
+                out.close();
+                remove(tempPath.c_str());
+                return false;
+            }
+        }
+        remove(cachePath.c_str());
+        return rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+private:
+    AssetFile file;
+    const MeshCacheHeader *header = nullptr;
+    const MeshCacheMeshRecord *meshes = nullptr;
+    const MeshCacheTextureRecord *textures = nullptr;
+    const MeshCacheLodRecord *lods = nullptr;
+    const MeshCacheBoneRecord *bones = nullptr;
+
+    bool fail()
+    {
+        Close();
+        return false;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    static void pad(ofstream &out, uint64_t offset)
+    {
+        static const char zeros[16] = {};
+        uint64_t current = static_cast<uint64_t>(out.tellp());
+        if (offset > current)
+            out.write(zeros, static_cast<streamsize>(offset - current));
+    }
+};
+#endif
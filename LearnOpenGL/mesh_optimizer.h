@@ -0,0 +1,324 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+using namespace std;
+
+// Import time index/vertex buffer optimizations for triangle lists:
+//   1. OptimizeVertexCache:  Tipsify (Sander, Nehab, Barczak 2007) triangle order for the post-transform cache
+//   2. OptimizeOverdraw:     reorders the resulting triangle clusters so outward facing ones come first (better early-Z)
+//   3. OptimizeVertexFetch:  renumbers the vertices in first use order so vertex fetches walk memory linearly
+// OptimizeMesh runs all of them on a MeshData and records the cache statistics before and after.
+
+// number of entries of the simulated FIFO post-transform cache
+#define VERTEX_CACHE_SIZE 16
+
+// simulates a FIFO post-transform cache. ACMR is transformed vertices per triangle (0.5 is the best a regular
+// grid can get, 3 is no reuse at all), ATVR transformed vertices per referenced vertex (1 is optimal).
+inline VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // a vertex is in the cache if fewer than cacheSize misses happened since it was loaded
+    vector<size_t> loadedAt(vertexCount, 0);
+    vector<bool> referenced(vertexCount, false);
+    size_t misses = 0, unique = 0;
+    for (unsigned int index : indices)
+    {
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            unique++;
+        }
+        if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize)
+        {
+            misses++;
+            loadedAt[index] = misses;
+        }
+    }
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(unique);
+    return stats;
+}
+
+// Tipsify: fans out from the current vertex, emitting all of its remaining triangles, then continues with the
+// adjacent vertex that is still in the cache and has the fewest triangles left. Runs in linear time.
+// If clusterStarts is given, it receives the first triangle of every run that starts with a cold cache.
+inline vector<unsigned int> OptimizeVertexCache(const vector<unsigned int> &indices, size_t vertexCount,
+    unsigned int cacheSize = VERTEX_CACHE_SIZE, vector<size_t> *clusterStarts = nullptr)
+{
+    size_t triangleCount = indices.size() / 3;
+    vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    if (clusterStarts)
+        clusterStarts->clear();
+    if (triangleCount == 0)
+        return result;
+
+    // vertex -> triangle adjacency
+    vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+        liveTriangles[index]++;
+    vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    vector<unsigned int> adjacency(indices.size());
+    vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    vector<size_t> cacheTime(vertexCount, 0);
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> deadEnd;
+    vector<unsigned int> candidates;
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    long long fanning = indices[0];
+    while (fanning >= 0)
+    {
+        unsigned int vertex = static_cast<unsigned int>(fanning);
+        if (clusterStarts && time - cacheTime[vertex] > cacheSize)
+            clusterStarts->push_back(result.size() / 3);
+
+        candidates.clear();
+        for (size_t a = adjacencyOffset[vertex]; a < adjacencyOffset[vertex + 1]; a++)
+        {
+            unsigned int triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int index = indices[triangle * 3 + corner];
+                result.push_back(index);
+                deadEnd.push_back(index);
+                candidates.push_back(index);
+                liveTriangles[index]--;
+                if (time - cacheTime[index] > cacheSize)
+                    cacheTime[index] = time++;
+            }
+        }
+
+        // next fanning vertex: the candidate that stays in the cache longest after its fan is emitted
+        fanning = -1;
+        long long bestPriority = -1;
+        for (unsigned int candidate : candidates)
+        {
+            if (liveTriangles[candidate] == 0)
+                continue;
+            long long priority = 0;
+            if (time - cacheTime[candidate] + 2 * liveTriangles[candidate] <= cacheSize)
+                priority = static_cast<long long>(time - cacheTime[candidate]);
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = candidate;
+            }
+        }
+        if (fanning >= 0)
+            continue;
+
+        // dead end: back track to a recently used vertex, or scan for any vertex with triangles left
+        while (!deadEnd.empty() && fanning < 0)
+        {
+            unsigned int recent = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[recent] > 0)
+                fanning = recent;
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+                fanning = static_cast<long long>(cursor);
+            cursor++;
+        }
+    }
+    return result;
+}
+
+// Sorts the triangle clusters of a vertex cache optimized index buffer front to back in a view independent way
+// (Nehab et al. 2006): clusters whose average normal points away from the mesh center are likely to occlude the
+// rest, so they're drawn first. Clusters are split further where that costs little cache efficiency; threshold
+// is the ACMR the result may have relative to the input (1.05 allows 5% more vertex shader invocations).
+inline vector<unsigned int> OptimizeOverdraw(const vector<unsigned int> &indices, const vector<size_t> &clusterStarts,
+    const Vertex *vertices, size_t vertexCount, float threshold = 1.05f, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusterStarts.empty())
+        return indices;
+
+    // soft boundaries: inside each hard cluster, cut wherever the triangles since the last cut reach an ACMR close to
+    // the one of the whole hard cluster, counting the cold cache every cut causes. Cheap cuts are taken, expensive ones aren't.
+    vector<size_t> starts;
+    vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0, coldFrom = 0;
+    auto transform = [&](size_t triangle) {
+        size_t triangleMisses = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            unsigned int index = indices[triangle * 3 + corner];
+            if (loadedAt[index] <= coldFrom || misses - loadedAt[index] >= cacheSize)
+            {
+                loadedAt[index] = ++misses;
+                triangleMisses++;
+            }
+        }
+        return triangleMisses;
+    };
+    for (size_t c = 0; c < clusterStarts.size(); c++)
+    {
+        size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+        coldFrom = misses;
+        size_t clusterMisses = 0;
+        for (size_t t = clusterStarts[c]; t < end; t++)
+            clusterMisses += transform(t);
+        float targetAcmr = float(clusterMisses) / float(end - clusterStarts[c]) * threshold;
+
+        size_t start = clusterStarts[c];
+        starts.push_back(start);
+        coldFrom = misses;
+        size_t softMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            softMisses += transform(t);
+            size_t softTriangles = t + 1 - start;
+            if (t + 1 < end && float(softMisses) <= targetAcmr * float(softTriangles))
+            {
+                start = t + 1;
+                starts.push_back(start);
+                coldFrom = misses;
+                softMisses = 0;
+            }
+        }
+    }
+
+    // area weighted centroid and normal of every cluster
+    struct Cluster {
+        size_t first, count;
+        float sortKey;
+    };
+    vector<Cluster> clusters(starts.size());
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    vector<glm::vec3> centroids(starts.size()), normals(starts.size());
+    vector<float> areas(starts.size());
+    for (size_t c = 0; c < starts.size(); c++)
+    {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = starts[c]; t < end; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(cross) * 0.5f;
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        clusters[c].first = starts[c];
+        clusters[c].count = end - starts[c];
+        centroids[c] = area > 0.0f ? centroid / area : centroid;
+        normals[c] = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : normal;
+        areas[c] = area;
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+    for (size_t c = 0; c < clusters.size(); c++)
+        clusters[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+    stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster &cluster : clusters)
+        result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + (cluster.first + cluster.count) * 3);
+    return result;
+}
+
+// renumbers the vertices in the order the index buffer first references them and drops unreferenced ones.
+inline void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    vector<unsigned int> remap(vertices.size(), unused);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+// runs the whole optimization pipeline on an imported triangle list and stores the statistics in mesh.optimizeStats.
+inline void OptimizeMesh(MeshData &mesh, bool optimizeOverdraw = false, float overdrawThreshold = 1.05f)
+{
+    if (mesh.indices.size() < 3 || mesh.indices.size() % 3 != 0)
+        return;
+    mesh.optimizeStats.before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    vector<size_t> clusterStarts;
+    mesh.indices = OptimizeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE, optimizeOverdraw ? &clusterStarts : nullptr);
+    if (optimizeOverdraw)
+    {
+        vector<unsigned int> sorted = OptimizeOverdraw(mesh.indices, clusterStarts, mesh.vertices.data(), mesh.vertices.size(), overdrawThreshold);
+        // the soft boundaries only estimate the cost, don't accept a result that ended up above the budget
+        float acmr = AnalyzeVertexCache(mesh.indices, mesh.vertices.size()).acmr;
+        if (AnalyzeVertexCache(sorted, mesh.vertices.size()).acmr <= acmr * overdrawThreshold)
+            mesh.indices.swap(sorted);
+    }
+    OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+    mesh.optimizeStats.after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+    mesh.optimizeStats.optimized = true;
+}
+
+// sums up the statistics of all meshes of a model, weighted by their triangle and vertex counts.
+struct VertexCacheReport {
+    double acmrBefore = 0.0, acmrAfter = 0.0;
+    double atvrBefore = 0.0, atvrAfter = 0.0;
+    size_t triangles = 0, vertices = 0;
+
+    void Add(const MeshOptimizeStats &stats, size_t indexCount, size_t vertexCount)
+    {
+        if (!stats.optimized)
+            return;
+        size_t meshTriangles = indexCount / 3;
+        acmrBefore += stats.before.acmr * meshTriangles;
+        acmrAfter += stats.after.acmr * meshTriangles;
+        atvrBefore += stats.before.atvr * vertexCount;
+        atvrAfter += stats.after.atvr * vertexCount;
+        triangles += meshTriangles;
+        vertices += vertexCount;
+    }
+
+    void Print(const string &name) const
+    {
+        if (triangles == 0 || vertices == 0)
+            return;
+        std::cout << "MESH::OPTIMIZE:: " << name << " ACMR " << acmrBefore / triangles << " -> " << acmrAfter / triangles
+            << ", ATVR " << atvrBefore / vertices << " -> " << atvrAfter / vertices << std::endl;
+    }
+};
+#endif
@@ -0,0 +1,302 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "file_utils.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+using namespace std;
+
+// Quadric error metric simplification (Garland, Heckbert 1997) with half-edge collapses: a vertex is always
+// merged into one of its neighbours, so the simplified levels only produce new index lists and can share the
+// vertex buffer of the full resolution mesh.
+// Vertices on open borders and on attribute seams (the same position stored with different normals/uvs) are
+// never moved, which keeps silhouettes, cracks and texture seams intact at the cost of simplifying less.
+
+// symmetric 4x4 matrix of the summed squared distances to a set of planes, each weighted by its triangle's area
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+    double weight = 0;
+
+    static Quadric FromPlane(const glm::vec3 &normal, float distance, float weight)
+    {
+        Quadric q;
+        double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        q.a2 = a * a * weight; q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * d * weight;
+        q.b2 = b * b * weight; q.bc = b * c * weight; q.bd = b * d * weight;
+        q.c2 = c * c * weight; q.cd = c * d * weight;
+        q.d2 = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric &q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+        return *this;
+    }
+
+    // area weighted mean squared distance of p to the planes
+    double Error(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                     + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                     + c2 * z * z + 2 * cd * z
+                     + d2;
+        return error > 0.0 && weight > 0.0 ? error / weight : 0.0;
+    }
+};
+
+// simplifies a triangle list until it has at most targetIndexCount indices or the next collapse would move the
+// surface further than maxError (in model units). Returns the new index list, resultError receives the largest
+// error of an applied collapse.
+inline vector<unsigned int> SimplifyMesh(const Vertex *vertices, size_t vertexCount, const vector<unsigned int> &indices,
+    size_t targetIndexCount, float maxError, float *resultError = nullptr)
+{
+    vector<unsigned int> result = indices;
+    if (resultError)
+        *resultError = 0.0f;
+    if (indices.size() <= targetIndexCount || vertexCount == 0)
+        return result;
+
+    // vertices sharing a position form one topological vertex
+    vector<unsigned int> positionId(vertexCount);
+    {
+        struct PositionHash {
+            size_t operator()(const glm::vec3 &p) const { return static_cast<size_t>(HashBytes(&p, sizeof(p))); }
+        };
+        unordered_map<glm::vec3, unsigned int, PositionHash> unique;
+        unique.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            positionId[v] = unique.emplace(vertices[v].Position, static_cast<unsigned int>(v)).first->second;
+    }
+
+    // lock seam vertices and vertices on open borders (edges used by only one triangle)
+    vector<bool> locked(vertexCount, false);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (positionId[v] != v)
+        {
+            locked[v] = true;
+            locked[positionId[v]] = true;
+        }
+    }
+    {
+        unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(indices.size());
+        auto edgeKey = [&](unsigned int a, unsigned int b) {
+            unsigned int pa = positionId[a], pb = positionId[b];
+            return pa < pb ? (uint64_t(pa) << 32) | pb : (uint64_t(pb) << 32) | pa;
+        };
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int e = 0; e < 3; e++)
+                edgeUse[edgeKey(indices[i + e], indices[i + (e + 1) % 3])]++;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+                if (edgeUse[edgeKey(a, b)] == 1)
+                {
+                    locked[a] = locked[positionId[a]] = true;
+                    locked[b] = locked[positionId[b]] = true;
+                }
+            }
+        }
+        // twins of locked positions are locked as well
+        for (size_t v = 0; v < vertexCount; v++)
+            locked[v] = locked[v] || locked[positionId[v]];
+    }
+
+    // area weighted plane quadrics, accumulated per position
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3 &p0 = vertices[indices[i + 0]].Position;
+        const glm::vec3 &p1 = vertices[indices[i + 1]].Position;
+        const glm::vec3 &p2 = vertices[indices[i + 2]].Position;
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normal /= length;
+        Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, p0), length * 0.5f);
+        for (int c = 0; c < 3; c++)
+            quadrics[positionId[indices[i + c]]] += plane;
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        double error;
+    };
+    vector<Collapse> collapses;
+    vector<unsigned int> remap(vertexCount);
+    vector<bool> touched(vertexCount);
+    vector<size_t> triangleOffset(vertexCount + 1);
+    vector<unsigned int> triangleList;
+    double maxErrorSquared = double(maxError) * double(maxError);
+    float appliedError = 0.0f;
+
+    // every pass collapses an independent set of the cheapest edges, then rebuilds the index list
+    while (result.size() > targetIndexCount)
+    {
+        // vertex -> triangle adjacency of the current index list
+        fill(triangleOffset.begin(), triangleOffset.end(), 0);
+        for (unsigned int index : result)
+            triangleOffset[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleOffset[v + 1] += triangleOffset[v];
+        triangleList.resize(result.size());
+        {
+            vector<size_t> cursor(triangleOffset.begin(), triangleOffset.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                triangleList[cursor[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+                // both directions of every edge are candidates, a half-edge collapse moves "from" onto "to"
+                unsigned int ends[2][2] = { { a, b }, { b, a } };
+                for (int d = 0; d < 2; d++)
+                {
+                    unsigned int from = ends[d][0], to = ends[d][1];
+                    if (locked[from])
+                        continue;
+                    Quadric q = quadrics[positionId[from]];
+                    q += quadrics[positionId[to]];
+                    double error = q.Error(vertices[to].Position);
+                    if (error <= maxErrorSquared)
+                        collapses.push_back({ from, to, error });
+                }
+            }
+        }
+        if (collapses.empty())
+            break;
+        sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<unsigned int>(v);
+        fill(touched.begin(), touched.end(), false);
+
+        // each collapse removes about two triangles; stop once enough are queued to reach the target
+        size_t removable = (result.size() - targetIndexCount) / 6 + 1;
+        size_t applied = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (applied >= removable)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // reject collapses that flip a triangle around "from"
+            const glm::vec3 &target = vertices[collapse.to].Position;
+            bool flips = false;
+            for (size_t t = triangleOffset[collapse.from]; t < triangleOffset[collapse.from + 1] && !flips; t++)
+            {
+                const unsigned int *triangle = &result[triangleList[t] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+                glm::vec3 p[3], moved[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    p[c] = vertices[triangle[c]].Position;
+                    moved[c] = triangle[c] == collapse.from ? target : p[c];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[positionId[collapse.to]] += quadrics[positionId[collapse.from]];
+            // the neighbourhood of "from" changed, nothing in it may collapse again during this pass
+            for (size_t t = triangleOffset[collapse.from]; t < triangleOffset[collapse.from + 1]; t++)
+            {
+                const unsigned int *triangle = &result[triangleList[t] * 3];
+                for (int c = 0; c < 3; c++)
+                    touched[triangle[c]] = true;
+            }
+            appliedError = max(appliedError, static_cast<float>(sqrt(collapse.error)));
+            applied++;
+        }
+        if (applied == 0)
+            break;
+
+        // drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+        *resultError = appliedError;
+    return result;
+}
+
+// builds a chain of up to maxLevels levels of detail into mesh.lods, each with about half the triangles of the
+// previous one. All levels are stored back to back in mesh.indices, level 0 is the original index list.
+// The chain ends early once a level can't be reduced by at least a quarter without exceeding maxError,
+// given relative to the radius of the mesh bounds.
+inline void GenerateLods(MeshData &mesh, unsigned int maxLevels = 4, float maxError = 0.05f)
+{
+    mesh.lods.clear();
+    ComputeMeshBounds(mesh);
+    if (mesh.indices.empty())
+        return;
+
+    size_t fullCount = mesh.indices.size();
+    mesh.lods.push_back({ 0, static_cast<uint32_t>(fullCount), 0.0f });
+
+    vector<unsigned int> previous = mesh.indices;
+    float absoluteMaxError = maxError * mesh.boundsRadius;
+    for (unsigned int level = 1; level < maxLevels; level++)
+    {
+        size_t target = (previous.size() / 2) / 3 * 3;
+        float error = 0.0f;
+        vector<unsigned int> simplified = SimplifyMesh(mesh.vertices.data(), mesh.vertices.size(), previous, target, absoluteMaxError, &error);
+        if (simplified.empty() || simplified.size() > previous.size() * 3 / 4)
+            break;
+        simplified = OptimizeVertexCache(simplified, mesh.vertices.size());
+
+        LodLevel lod;
+        lod.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+        lod.indexCount = static_cast<uint32_t>(simplified.size());
+        // levels are simplified from their predecessor, so the error bound adds up over the chain
+        lod.error = mesh.lods.back().error + error;
+        mesh.lods.push_back(lod);
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+    if (mesh.lods.size() == 1)
+        mesh.lods.clear();
+}
+#endif
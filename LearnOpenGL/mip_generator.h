@@ -0,0 +1,136 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// 2x2 box filters that halve RGBA8 images, used to build mip chains on the CPU (in the texture decode workers)
+// instead of glGenerateMipmap on the GL thread. Odd sizes round down and drop the last row/column, like GL does.
+// The plain filter averages the stored values and runs 4 pixels at a time with SSE2 where available. The sRGB
+// variant averages color in linear light and alpha as stored, so mips of gamma encoded textures don't darken.
+
+// halves an RGBA8 image with a 2x2 box filter. Odd edges are clamped.
+inline void DownsampleRGBA8(const vector<unsigned char> &src, int width, int height, vector<unsigned char> &dst, int &dstWidth, int &dstHeight)
+{
+    dstWidth = max(1, width / 2);
+    dstHeight = max(1, height / 2);
+    dst.resize(size_t(dstWidth) * size_t(dstHeight) * 4);
+    for (int y = 0; y < dstHeight; y++)
+    {
+        int y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+        const unsigned char *row0 = &src[size_t(y0) * width * 4];
+        const unsigned char *row1 = &src[size_t(y1) * width * 4];
+        unsigned char *out = &dst[size_t(y) * dstWidth * 4];
+        int x = 0;
+#ifdef MIP_GENERATOR_SSE2
+        // 8 source pixels of two rows -> 4 destination pixels. Needs both source columns, so not for 1 wide images.
+        if (width >= 2)
+        {
+            const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+            for (; x + 4 <= dstWidth; x += 4)
+            {
+                __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+                __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+                __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+                // vertical sums in 16 bit, two pixels per register
+                __m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero));
+                __m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero));
+                __m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero));
+                __m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero));
+                // horizontal pairs: the low half of each register receives the sum of its two pixels
+                p01 = _mm_add_epi16(p01, _mm_srli_si128(p01, 8));
+                p23 = _mm_add_epi16(p23, _mm_srli_si128(p23, 8));
+                p45 = _mm_add_epi16(p45, _mm_srli_si128(p45, 8));
+                p67 = _mm_add_epi16(p67, _mm_srli_si128(p67, 8));
+                __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p01, p23), two), 2);
+                __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p45, p67), two), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(lo, hi));
+            }
+        }
+#endif
+        for (; x < dstWidth; x++)
+        {
+            int x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                out[x * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// lookup tables between 8 bit sRGB and 16 bit linear values
+struct SRGBTables {
+    uint16_t toLinear[256];
+    // indexed by linear >> 4
+    unsigned char fromLinear[4096];
+
+    SRGBTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            double c = i / 255.0;
+            double linear = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+            toLinear[i] = static_cast<uint16_t>(linear * 65535.0 + 0.5);
+        }
+        for (int i = 0; i < 4096; i++)
+        {
+            double linear = (i + 0.5) / 4096.0;
+            double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+            fromLinear[i] = static_cast<unsigned char>(min(max(c * 255.0 + 0.5, 0.0), 255.0));
+        }
+    }
+
+    static const SRGBTables& Instance()
+    {
+        static SRGBTables tables;
+        return tables;
+    }
+};
+
+// halves an sRGB encoded RGBA8 image, averaging RGB in linear light.
+inline void DownsampleSRGBA8(const vector<unsigned char> &src, int width, int height, vector<unsigned char> &dst, int &dstWidth, int &dstHeight)
+{
+    const SRGBTables &tables = SRGBTables::Instance();
+    dstWidth = max(1, width / 2);
+    dstHeight = max(1, height / 2);
+    dst.resize(size_t(dstWidth) * size_t(dstHeight) * 4);
+    for (int y = 0; y < dstHeight; y++)
+    {
+        int y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+        const unsigned char *row0 = &src[size_t(y0) * width * 4];
+        const unsigned char *row1 = &src[size_t(y1) * width * 4];
+        unsigned char *out = &dst[size_t(y) * dstWidth * 4];
+        for (int x = 0; x < dstWidth; x++)
+        {
+            int x0 = min(x * 2, width - 1) * 4, x1 = min(x * 2 + 1, width - 1) * 4;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]]
+                                 + tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+                out[x * 4 + c] = tables.fromLinear[((sum + 2) / 4) >> 4];
+            }
+            int alpha = row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3];
+            out[x * 4 + 3] = static_cast<unsigned char>((alpha + 2) / 4);
+        }
+    }
+}
+
+inline void DownsampleMip(const vector<unsigned char> &src, int width, int height, bool srgb, vector<unsigned char> &dst, int &dstWidth, int &dstHeight)
+{
+    if (srgb)
+        DownsampleSRGBA8(src, width, height, dst, dstWidth, dstHeight);
+    else
+        DownsampleRGBA8(src, width, height, dst, dstWidth, dstHeight);
+}
+#endif
@@ -13,134 +13,1155 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <atomic>
+#include <climits>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "asset_io_system.h"
+#include "camera.h"
+#include "geometry_arena.h"
+#include "gltf_loader.h"
+#include "gpu_resources.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_loader.h"
+#include "skinning.h"
 #include "stb_image.h"
+#include "texture_loader.h"
+#include "texture_registry.h"
+#include "texture_streamer.h"
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+inline unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, const TextureCookSettings *cook = nullptr);
 
-class Model 
+// the attribute checks are template parameters, so each combination gets its own loop without any per vertex branches.
+template <bool Normals, bool TexCoords, bool Tangents>
+void ImportVertexRange(const aiMesh *mesh, Vertex *out)
+{
+    const aiVector3D *positions = mesh->mVertices;
+    const aiVector3D *normals = mesh->mNormals;
+    const aiVector3D *texCoords = mesh->mTextureCoords[0];
+    const aiVector3D *tangents = mesh->mTangents;
+    const aiVector3D *bitangents = mesh->mBitangents;
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex &vertex = out[i];
+        vertex.Position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+        vertex.Normal = Normals ? glm::vec3(normals[i].x, normals[i].y, normals[i].z) : glm::vec3(0.0f);
+        // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+        // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+        vertex.TexCoords = TexCoords ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f);
+        vertex.Tangent = Tangents ? glm::vec3(tangents[i].x, tangents[i].y, tangents[i].z) : glm::vec3(0.0f);
+        vertex.Bitangent = Tangents ? glm::vec3(bitangents[i].x, bitangents[i].y, bitangents[i].z) : glm::vec3(0.0f);
+        SetVertexBoneDataToDefault(vertex);
+    }
+}
+
+// converts the vertices of an Assimp mesh in one pass into a buffer that is sized once up front.
+inline void ImportVertices(const aiMesh *mesh, vector<Vertex> &vertices)
+{
+    vertices.resize(mesh->mNumVertices);
+    Vertex *out = vertices.data();
+    bool normals = mesh->HasNormals();
+    bool texCoords = mesh->mTextureCoords[0] != nullptr;
+    // tangents are only meaningful with texture coordinates, CalcTangentSpace needs them
+    bool tangents = texCoords && mesh->HasTangentsAndBitangents();
+    if (normals)
+    {
+        if (tangents)
+            ImportVertexRange<true, true, true>(mesh, out);
+        else if (texCoords)
+            ImportVertexRange<true, true, false>(mesh, out);
+        else
+            ImportVertexRange<true, false, false>(mesh, out);
+    }
+    else
+    {
+        if (tangents)
+            ImportVertexRange<false, true, true>(mesh, out);
+        else if (texCoords)
+            ImportVertexRange<false, true, false>(mesh, out);
+        else
+            ImportVertexRange<false, false, false>(mesh, out);
+    }
+}
+
+// Assimp's matrices are row major, glm's column major
+inline glm::mat4 ConvertMatrix(const aiMatrix4x4 &m)
+{
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+}
+
+// copies the face indices, with a fast path for the triangles aiProcess_Triangulate produces.
+inline void ImportIndices(const aiMesh *mesh, vector<unsigned int> &indices)
+{
+    size_t count = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        count += mesh->mFaces[i].mNumIndices;
+    indices.resize(count);
+    unsigned int *out = indices.data();
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace &face = mesh->mFaces[i];
+        if (face.mNumIndices == 3)
+        {
+            out[0] = face.mIndices[0];
+            out[1] = face.mIndices[1];
+            out[2] = face.mIndices[2];
+            out += 3;
+            continue;
+        }
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+            *out++ = face.mIndices[j];
+    }
+}
+
+// options that control how a model is imported.
+struct ModelLoadOptions {
+    bool gammaCorrection = false;
+    // read the converted meshes from (and write them to) a binary cache next to the source file,
+    // so Assimp only runs when the cache is missing or stale.
+    bool useMeshCache = true;
+    // also share textures whose files have identical content under different paths.
+    bool shareTexturesByContent = false;
+    // upload textures block compressed with precomputed mipmaps: BC7 (or BC1/BC3 with only S3TC) for color maps,
+    // BC5 for normal maps, whose shaders then have to rebuild z from x and y. The compressed versions are read
+    // from .dds files next to the images (see Tools/TextureCooker.cpp) or cooked on load when missing or stale,
+    // and written back there if writeCookedTextures is set. Writing is opt in, it adds files beside the images.
+    bool compressTextures = false;
+    bool writeCookedTextures = false;
+    // build the mip chains of uncompressed textures in the decode workers (filtered in linear light when
+    // gammaCorrection is set) instead of with glGenerateMipmap, and cache them in .mips.dds files the same way.
+    bool cpuMipmaps = true;
+    // hand textures with a CPU mip chain (cpuMipmaps or compressTextures) to the TextureStreamer, which starts them
+    // with their smallest levels and raises them as Draw(shader, camera, ...) reports how large they are on screen.
+    // Call TextureStreamer::Instance().Update() once per frame; its settings hold the GPU memory budget.
+    bool streamTextures = false;
+    // import on a background thread. The constructor returns right away and Update() uploads the meshes
+    // as they become ready, so the render loop keeps running while the model streams in.
+    bool asyncLoad = false;
+    // meshes uploaded per Update() call while loading asynchronously
+    unsigned int meshUploadsPerUpdate = 4;
+    // let Assimp read the model through AssetIOSystem: memory mapped files and mounted archives.
+    bool mappedImport = true;
+    // read .obj files with the multithreaded loader in obj_loader.h instead of Assimp. Falls back to Assimp
+    // if the loader rejects the file.
+    bool nativeObjLoader = true;
+    // read .glb/.gltf files with the loader in gltf_loader.h, which copies the accessors straight into the mesh
+    // layout and decodes embedded images on the texture workers. Falls back to Assimp if the loader rejects the file.
+    bool nativeGltfLoader = true;
+    // import post-processing. Welding merges the corners Assimp's importers emit as separate vertices (an OBJ has one
+    // per face corner), ImproveCacheLocality is Assimp's own vertex cache pass (optimizeMeshes below does the same
+    // after import, so it's off by default), and redundant material removal merges identical materials.
+    bool joinIdenticalVertices = true;
+    bool improveCacheLocality = false;
+    bool removeRedundantMaterials = true;
+    // only compute tangents for meshes whose material has a normal map (texture_normal); the others get zero tangents.
+    bool tangentsForNormalMapsOnly = true;
+    // upload meshes in the compact PackedVertex layout, draw them with lighting_packed.vert. Models with more than
+    // MAX_PACKED_BONES bones keep the full layout.
+    bool packedVertices = false;
+    // give every mesh an extra position-only vertex stream, read by DrawDepth() (depth.vert).
+    bool positionStream = false;
+    // reorder each mesh's triangles for the post-transform vertex cache and its vertices for fetch locality.
+    // runs once at import, the result is stored in the mesh cache.
+    bool optimizeMeshes = true;
+    // additionally sort triangle clusters to reduce overdraw, allowing the ACMR to grow by overdrawThreshold.
+    bool optimizeOverdraw = false;
+    float overdrawThreshold = 1.05f;
+    // build up to lodLevels levels of detail per mesh (level 0 is the full mesh), each with about half the triangles.
+    // simplification stops at lodMaxError, relative to the mesh's bounding radius. Stored in the mesh cache.
+    bool generateLods = true;
+    unsigned int lodLevels = 4;
+    float lodMaxError = 0.05f;
+    // Draw(shader, camera, ...) uses the coarsest level whose error projects to at most this many pixels
+    float lodPixelError = 1.0f;
+    // put all meshes into one vertex and one index buffer per vertex layout (see GeometryArena) instead of
+    // a VAO/VBO/EBO per mesh, so drawing the model doesn't rebind buffers between meshes.
+    bool sharedGeometry = true;
+    // drop each mesh's CPU copy of its vertices and indices once it's uploaded. Only counts, bounds and LOD ranges stay.
+    bool releaseCpuData = false;
+    // once loaded, copy the textures into texture arrays (see TextureArraySet) grouped by size and format, so Draw
+    // binds them once and meshes only select layers; draw with lighting_array.frag once TextureArrays() isn't empty.
+    // Until then, and if the arrays can't be built, meshes bind their 2D textures as usual and need lighting.frag.
+    // Once the arrays exist the model releases its 2D textures, a reloaded image goes straight into its layer. Not
+    // combined with streamTextures, whose levels change after the copy.
+    bool textureArrays = false;
+    // once loaded, let the GpuResourceManager evict the model's meshes and textures when the GPU memory is over its
+    // budget and the model wasn't drawn lately. The next draw starts loading it again in the background the same
+    // way, from the mesh cache and cooked textures if they're there, even without asyncLoad so the frame doesn't
+    // stall. Its meshes then appear as Update() (or, without asyncLoad, the following draws) upload them.
+    bool evictable = true;
+};
+
+// the Assimp post-processing steps the options ask for
+inline unsigned int ImportFlags(const ModelLoadOptions &options)
+{
+    unsigned int flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
+    if (!options.tangentsForNormalMapsOnly)
+        flags |= aiProcess_CalcTangentSpace;
+    if (options.joinIdenticalVertices)
+        flags |= aiProcess_JoinIdenticalVertices;
+    if (options.improveCacheLocality)
+        flags |= aiProcess_ImproveCacheLocality;
+    if (options.removeRedundantMaterials)
+        flags |= aiProcess_RemoveRedundantMaterials;
+    return flags;
+}
+
+// vertex and index counts of a model's meshes as the source file has them (faces triangulated, every corner
+// its own vertex unless the format indexes them already) and after import post-processing, to measure welding.
+// Levels of detail are not counted.
+struct ModelImportStats {
+    size_t meshes = 0;
+    size_t sourceVertices = 0;
+    size_t sourceIndices = 0;
+    size_t vertices = 0;
+    size_t indices = 0;
+    // meshes that got tangents
+    size_t tangentMeshes = 0;
+
+    void Print(const string &path) const
+    {
+        cout << "MODEL::IMPORT:: " << path << ": " << meshes << " meshes, vertices " << sourceVertices << " -> " << vertices
+            << ", indices " << sourceIndices << " -> " << indices << ", tangents on " << tangentMeshes << " meshes" << endl;
+    }
+};
+
+class Model : public EvictableResource
 {
 public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh>    meshes;
+    vector<Mesh>    meshes;	// only meshes whose GPU upload has completed, so Draw never touches a mesh that isn't resident.
     string directory;
     bool gammaCorrection;
+    ModelLoadOptions options;
+    // counts of the last import, all zero when the meshes came from the mesh cache. Set once IsLoaded().
+    ModelImportStats importStats;
+    // the bones of all skinned meshes; Vertex::m_BoneIDs index this table, so do the palettes the skinning shaders read.
+    // Set once IsLoaded(), the import thread fills its own copy until then.
+    vector<BoneInfo> bones;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
-        loadModel(path);
+        options.gammaCorrection = gamma;
+        loadModel(path, options.asyncLoad);
+    }
+
+    Model(string const &path, const ModelLoadOptions &options) : gammaCorrection(options.gammaCorrection), options(options)
+    {
+        loadModel(path, options.asyncLoad);
+    }
+
+    // textures are shared through the TextureRegistry, every model holds one reference per unique texture.
+    ~Model()
+    {
+        GpuResourceManager::Instance().Unregister(*this);
+        if (importThread.joinable())
+        {
+            cancelImport = true;
+            importThread.join();
+        }
+        if (textureLoader)
+        {
+            // destroyed while still loading: release by loader ticket, textures_loaded may be incomplete
+            textureLoader->Wait();
+            for (size_t t = 0; t < textureLoader->Count(); t++)
+            {
+                const TextureLoader::Entry &entry = textureLoader->GetEntry(t);
+                unsigned int id = t < ticketIds.size() ? ticketIds[t] : 0;
+                if (id == 0 && entry.resolved)
+                    id = entry.id;
+                if (id != 0)
+                    releaseTexture(id);
+            }
+            return;
+        }
+        for (const Texture &texture : textures_loaded)
+            releaseTexture(texture.id);
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // true once every mesh and texture of the model is resident on the GPU.
+    bool IsLoaded() const { return loaded; }
+
+    const string& Path() const { return modelPath; }
+    // how the model's textures were cooked, to load them again the same way
+    const TextureCookSettings& TextureCook() const { return textureCook; }
+    // goes up whenever the meshes and textures change: once loaded and after every reload
+    unsigned int Revision() const { return revision; }
+
+    // call once per frame on the GL thread while an asynchronously loaded model streams in or reloads.
+    // uploads the textures that finished decoding and the meshes that are ready, a few per call.
+    bool Update()
+    {
+        // loads again once it's drawn
+        if (evicted)
+            return false;
+        if (reloadRequested && loaded)
+        {
+            reloadRequested = false;
+            Reload();
+        }
+        if (reloading && reloading->Update())
+            finishReload();
+        return uploadPending(options.meshUploadsPerUpdate);
+    }
+
+    // imports the model file again in the background, e.g. after it changed on disk, bypassing the mesh cache.
+    // The current meshes keep drawing until the new ones are all resident and are then swapped in within one
+    // Update(); if the import fails they stay. Textures still in the registry are shared with the current version
+    // instead of loaded again (changed image files reload on their own, see HotReload), so images embedded in a .glb
+    // stay as they were.
+    void Reload()
+    {
+        if (!loaded)
+        {
+            reloadRequested = true;
+            return;
+        }
+        ModelLoadOptions staged = options;
+        staged.asyncLoad = true;
+        // swapped into this model, which is the one registered
+        staged.evictable = false;
+        // replaces (and cancels) a reload that is still running
+        reloading.reset(new Model(modelPath, staged, false));
+    }
+
+    bool IsReloading() const { return reloading != nullptr || reloadRequested; }
+
+    // true while the GpuResourceManager has the meshes and textures evicted, until the next draw
+    bool IsEvicted() const { return evicted; }
+
+    string ResourceName() const override { return modelPath; }
+
+    // frees the meshes, the shared geometry and the texture arrays and drops the model's texture references (shared
+    // textures stay for the other models). Bones and import stats are kept until the next draw loads it again.
+    bool Evict() override
+    {
+        if (!loaded || reloading || reloadRequested)
+            return false;
+        for (const Texture &texture : textures_loaded)
+            releaseTexture(texture.id);
+        textures_loaded.clear();
+        textureIndex.clear();
+        meshes.clear();
+        for (unsigned int index = 0; index < 3; index++)
+            arenas[index].reset();
+        arenasReserved = false;
+        materialArrays.Clear();
+        textureLayers.clear();
+        loaded = false;
+        evicted = true;
+        return true;
+    }
+
+    // GL thread: writes a reloaded image (see HotReload) into the texture array layer of a material texture, given
+    // by its path as in textures_loaded. Either levels or image holds it, as LoadOrCookTexture returns them. Returns
+    // false if the model doesn't draw that texture from its arrays. An image that no longer fits its layer (another
+    // size or format) keeps the previous version, the 2D textures it would take to build the arrays again are gone.
+    bool TextureChanged(const string &path, const TextureLevels &levels, const DecodedImage &image)
+    {
+        auto found = textureLayers.find(path);
+        if (found == textureLayers.end())
+            return false;
+        bool updated = levels.codec != CODEC_NONE ? materialArrays.Update(found->second, levels) : materialArrays.Update(found->second, image);
+        if (!updated)
+            cout << "ERROR::TEXTURE::RELOAD:: " << path << " no longer fits its texture array in " << modelPath << ", keeping the previous version" << endl;
+        return true;
+    }
+
+    // the texture arrays Draw binds, empty unless loaded with textureArrays
+    const TextureArraySet& TextureArrays() const { return materialArrays; }
+
+    // index of a bone in bones, -1 if the model has no bone of that name
+    int FindBone(const string &name) const
+    {
+        auto found = boneIndex.find(name);
+        return found != boneIndex.end() ? found->second : -1;
     }
 
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        touch();
+        beginDraw(shader);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            drawMesh(shader, meshes[i], 0);
+        finishDraw();
+    }
+
+    // draws the model with a level of detail per mesh, chosen from how large the mesh's error would be on screen.
+    // modelMatrix has to be the matrix the shader transforms with, screenHeight the viewport height in pixels.
+    void Draw(Shader &shader, const Camera &camera, const glm::mat4 &modelMatrix, float screenHeight)
+    {
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        // pixels covered by one world unit at distance 1
+        float pixelsPerUnit = screenHeight / (2.0f * tan(glm::radians(camera.Zoom) * 0.5f));
+        touch();
+        beginDraw(shader);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundsCenter, 1.0f));
+            // the closest point of the bounding sphere decides, so a level never pops in right in front of the camera
+            float distance = glm::length(center - camera.Position) - mesh.boundsRadius * scale;
+            unsigned int lod = 0;
+            if (distance > 0.0f)
+                lod = mesh.SelectLod(pixelsPerUnit * scale / distance, options.lodPixelError);
+            if (options.streamTextures)
+            {
+                // the mesh's diameter on screen, assuming its textures are mapped across it once
+                float pixels = distance > 0.0f ? 2.0f * mesh.boundsRadius * scale * pixelsPerUnit / distance : screenHeight;
+                for (const Texture &texture : mesh.textures)
+                    TextureStreamer::Instance().Request(texture.id, pixels);
+            }
+            drawMesh(shader, mesh, lod);
+        }
+        finishDraw();
+    }
+
+    // draws positions only, e.g. for a depth prepass or a shadow map. The caller binds a position-only
+    // shader such as depth.vert; meshes loaded with positionStream read their compact position buffer.
+    void DrawDepth()
+    {
+        touch();
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            bindVertexArray(meshes[i].DepthVAO());
+            meshes[i].DrawElements();
+        }
+        finishDraw();
     }
     
 private:
+    // a converted mesh waiting on the GL thread for its upload
+    struct PendingMesh {
+        MeshData data;
+        // set instead of data.vertices/indices when the geometry lives in the mapped mesh cache
+        const Vertex *vertexData = nullptr;
+        size_t vertexCount = 0;
+        const unsigned int *indexData = nullptr;
+        size_t indexCount = 0;
+        // loader ticket of every entry in data.textures
+        vector<size_t> textureTickets;
+
+        const Vertex* Vertices() const { return vertexData ? vertexData : data.vertices.data(); }
+        size_t VertexCount() const { return vertexData ? vertexCount : data.vertices.size(); }
+        const unsigned int* Indices() const { return indexData ? indexData : data.indices.data(); }
+        size_t IndexCount() const { return indexData ? indexCount : data.indices.size(); }
+    };
+
+    Model(string const &path, const ModelLoadOptions &options, bool readMeshCache)
+        : gammaCorrection(options.gammaCorrection), options(options), readMeshCache(readMeshCache)
+    {
+        loadModel(path, options.asyncLoad);
+    }
+
+    // import side (the import thread when loading asynchronously)
+    bool readMeshCache = true;
+    TextureCookSettings textureCook;
+    // what the import found, handed to bones, boneIndex and importStats once the model is loaded
+    vector<BoneInfo> importedBones;
+    unordered_map<string, int> importedBoneIndex;
+    ModelImportStats importedStats;
+    // the layout the meshes are uploaded in, set before the first one is queued
+    Vertex_Format vertexFormat = FULL_VERTEX;
+    unique_ptr<TextureLoader> textureLoader;
+    unordered_map<string, size_t> textureTickets;	// material texture path -> loader ticket
+    MeshCache meshCache;	// stays mapped until every mesh read from it is uploaded
+    string modelPath;
+    unique_ptr<GltfModel> gltf;	// stays mapped until its embedded images are decoded
+    deque<PendingMesh> pendingMeshes;
+    mutex pendingMutex;
+    thread importThread;
+    atomic<bool> importDone{false};
+    atomic<bool> cancelImport{false};
+
+    // GL side
+    vector<unsigned int> ticketIds;	// registered texture id per loader ticket, 0 while it's still pending
+    unordered_map<string, size_t> textureIndex;	// material texture path -> index into textures_loaded
+    bool loaded = false;
+    unordered_map<string, int> boneIndex;	// bone name -> index into bones
+    // shared geometry, indexed by arenaIndex()
+    unique_ptr<GeometryArena> arenas[3];
+    bool arenasReserved = false;
+    // copies of textures_loaded, built once loaded with options.textureArrays
+    TextureArraySet materialArrays;
+    unordered_map<string, TextureLayer> textureLayers;	// material texture path -> its layer in materialArrays
+    // VAO bound by the current Draw call, so meshes sharing an arena don't rebind it
+    unsigned int boundVAO = 0;
+    unsigned int revision = 0;
+    // the next version while a reload is in progress
+    unique_ptr<Model> reloading;
+    bool reloadRequested = false;
+    bool evicted = false;
+    bool restoring = false;	// loading again after an eviction
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (vao != boundVAO)
+        {
+            glBindVertexArray(vao);
+            boundVAO = vao;
+        }
+    }
+
+    // marks the model as drawn this frame, and starts loading it again if it was evicted
+    void touch()
+    {
+        if (evicted)
+            restore();
+        // nothing calls Update() for a model loaded synchronously, its restore progresses as it's drawn
+        else if (restoring && !options.asyncLoad)
+            uploadPending(options.meshUploadsPerUpdate);
+        GpuResourceManager::Instance().Touch(*this);
+    }
+
+    // GL thread: starts loading an evicted model the way it was loaded the first time, always on the import thread
+    // so the draw that needs it doesn't wait for the import. The import refills the bones.
+    void restore()
+    {
+        restoring = true;
+        evicted = false;
+        importedBones.clear();
+        importedBoneIndex.clear();
+        importedStats = ModelImportStats();
+        importDone = false;
+        cancelImport = false;
+        cout << "MODEL::RESTORE:: " << modelPath << endl;
+        loadModel(modelPath, true);
+    }
+
+    void beginDraw(Shader &shader)
+    {
+        if (!materialArrays.Empty())
+            materialArrays.Bind(shader);
+    }
+
+    void drawMesh(Shader &shader, Mesh &mesh, unsigned int lod)
+    {
+        // resident meshes of a model still loading draw with their 2D textures until the arrays are built
+        if (!materialArrays.Empty())
+            mesh.BindTextureLayers(shader);
+        else
+            mesh.BindTextures(shader);
+        bindVertexArray(mesh.VAO);
+        mesh.DrawElements(lod);
+    }
+
+    // GL thread: packs the model's textures into arrays and points every mesh at its layers. Without arrays (not
+    // asked for, or too many sizes and formats) the meshes bind their textures one by one.
+    void buildTextureArrays()
+    {
+        materialArrays.Clear();
+        textureLayers.clear();
+        if (!options.textureArrays)
+            return;
+        if (options.streamTextures)
+        {
+            cout << "WARNING::MODEL:: " << modelPath << ": textureArrays don't work with streamTextures, binding textures per mesh" << endl;
+            return;
+        }
+        vector<unsigned int> ids;
+        for (const Texture &texture : textures_loaded)
+            ids.push_back(texture.id);
+        vector<TextureLayer> placed;
+        if (!materialArrays.Build(ids, placed))
+        {
+            cout << "WARNING::MODEL:: " << modelPath << ": binding textures per mesh, draw with lighting.frag" << endl;
+            return;
+        }
+        for (size_t i = 0; i < textures_loaded.size(); i++)
+            textureLayers[textures_loaded[i].path] = placed[i];
+        for (Mesh &mesh : meshes)
+        {
+            mesh.layers = MaterialLayers();
+            for (Texture &texture : mesh.textures)
+            {
+                TextureLayer *slot = texture.type == "texture_diffuse" ? &mesh.layers.diffuse :
+                    texture.type == "texture_specular" ? &mesh.layers.specular :
+                    texture.type == "texture_normal" ? &mesh.layers.normal :
+                    texture.type == "texture_height" ? &mesh.layers.height : nullptr;
+                if (slot && slot->array < 0)
+                    *slot = textureLayers[texture.path];
+                texture.id = 0;
+            }
+        }
+        // the arrays are all the model draws from now, the 2D textures would only double the memory
+        for (Texture &texture : textures_loaded)
+        {
+            releaseTexture(texture.id);
+            texture.id = 0;
+        }
+        cout << "MODEL:: " << modelPath << ": " << materialArrays.LayerCount() << " textures in " << materialArrays.ArrayCount() << " texture arrays" << endl;
+    }
+
+    void finishDraw()
+    {
+        bindVertexArray(0);
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    // async imports on the import thread and leaves the uploads to uploadPending.
+    void loadModel(string const &path, bool async)
+    {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        modelPath = path;
+
+        // textures are decoded on the thread pool as soon as the import references them
+        textureLoader.reset(new TextureLoader(options.shareTexturesByContent));
+        textureCook.compress = options.compressTextures;
+        if (textureCook.compress)
+            textureCook.support = QueryTextureCompressionSupport();
+        textureCook.cpuMipmaps = options.cpuMipmaps;
+        textureCook.srgbMips = options.gammaCorrection;
+        textureCook.writeCooked = options.writeCookedTextures;
+        textureLoader->SetCookSettings(textureCook);
+
+        if (async)
+        {
+            importThread = thread([this, path]() {
+                importModel(path);
+                importDone = true;
+            });
+            return;
+        }
+
+        importModel(path);
+        importDone = true;
+        textureLoader->Wait();
+        uploadPending(UINT_MAX);
+    }
+
+    // reads the model (from the mesh cache, with the native OBJ/glTF loaders or through Assimp) and queues its meshes for upload. Touches no GL state.
+    void importModel(string const &path)
+    {
+        const unsigned int importFlags = ImportFlags(options);
+        unsigned int buildFlags = 0;
+        if (options.optimizeMeshes)
+            buildFlags |= MESH_BUILD_VERTEX_CACHE | (options.optimizeOverdraw ? MESH_BUILD_OVERDRAW : 0);
+        if (options.generateLods)
+            buildFlags |= MESH_BUILD_LODS | (min(options.lodLevels, 255u) << 8);
+        bool nativeObj = options.nativeObjLoader && HasObjExtension(path);
+        if (nativeObj)
+            buildFlags |= MESH_BUILD_NATIVE_OBJ;
+        bool nativeGltf = options.nativeGltfLoader && HasGltfExtension(path);
+        if (nativeGltf)
+            buildFlags |= MESH_BUILD_NATIVE_GLTF;
+        if (options.tangentsForNormalMapsOnly)
+            buildFlags |= MESH_BUILD_NORMAL_MAP_TANGENTS;
+        MeshCacheKey cacheKey;
+        bool canCache = options.useMeshCache && MeshCache::MakeKey(path, importFlags, buildFlags, cacheKey);
+        if (buildFlags & MESH_BUILD_OVERDRAW)
+            cacheKey.overdrawThreshold = options.overdrawThreshold;
+        if (buildFlags & MESH_BUILD_LODS)
+            cacheKey.lodMaxError = options.lodMaxError;
+        if (canCache && readMeshCache && loadFromCache(MeshCache::CachePathFor(path), cacheKey))
+            return;
+
+        vector<PendingMesh> converted;
+        bool imported = (nativeObj && importObj(path, converted)) || (nativeGltf && importGltf(path, converted));
+        if (!imported && !importAssimp(path, importFlags, converted))
+            return;
+        if (cancelImport)
+            return;
+        importedStats.meshes = converted.size();
+        for (const PendingMesh &mesh : converted)
+        {
+            importedStats.vertices += mesh.data.vertices.size();
+            importedStats.indices += mesh.data.indices.size();
+            if (HasTangents(mesh.data.vertices))
+                importedStats.tangentMeshes++;
+        }
+        importedStats.Print(path);
+        chooseVertexFormat(path);
+        postProcessMeshes(converted);
+        if (options.optimizeMeshes)
+        {
+            VertexCacheReport report;
+            for (const PendingMesh &mesh : converted)
+                report.Add(mesh.data.optimizeStats, mesh.data.indices.size(), mesh.data.vertices.size());
+            report.Print(path);
+        }
+
+        // a model served from a mounted pack has no real directory to write next to (and PackBuilder leaves the
+        // caches out), so it is imported from the pack every time
+        if (canCache && !AssetFileSystem::Instance().Find(path))
+        {
+            vector<const MeshData*> cacheMeshes;
+            for (const PendingMesh &mesh : converted)
+                cacheMeshes.push_back(&mesh.data);
+            if (!MeshCache::Write(MeshCache::CachePathFor(path), cacheKey, cacheMeshes, importedBones))
+                cout << "WARNING::MESH_CACHE:: could not write cache for " << path << endl;
+        }
+
+        lock_guard<mutex> lock(pendingMutex);
+        for (PendingMesh &mesh : converted)
+            pendingMeshes.push_back(std::move(mesh));
+    }
+
+    // reads file via ASSIMP and converts its meshes
+    bool importAssimp(string const &path, unsigned int importFlags, vector<PendingMesh> &converted)
     {
-        // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        // memory map the files (or read them out of the mounted asset archives) instead of buffered stdio
+        if (options.mappedImport)
+            importer.SetIOHandler(new AssetIOSystem());
+        // read without post-processing first to count what the file holds, then apply the steps to the same scene
+        const aiScene* scene = importer.ReadFile(path, 0);
+        if (scene)
+        {
+            for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+            {
+                const aiMesh *mesh = scene->mMeshes[i];
+                importedStats.sourceVertices += mesh->mNumVertices;
+                for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+                    importedStats.sourceIndices += mesh->mFaces[f].mNumIndices >= 3 ? (mesh->mFaces[f].mNumIndices - 2) * 3 : 0;
+            }
+            scene = importer.ApplyPostProcessing(importFlags);
+        }
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, converted);
+        return true;
+    }
+
+    // reads an .obj file with the native loader, one mesh per object and material
+    bool importObj(string const &path, vector<PendingMesh> &converted)
+    {
+        ObjModel obj;
+        ObjLoadSettings settings;
+        settings.tangentsOnlyWithBumpMap = options.tangentsForNormalMapsOnly;
+        if (!LoadObj(path, obj, settings))
+            return false;
+        for (ObjMesh &mesh : obj.meshes)
+        {
+            // every face corner is a vertex of its own before welding
+            importedStats.sourceVertices += mesh.indices.size();
+            importedStats.sourceIndices += mesh.indices.size();
+            PendingMesh pending;
+            pending.data.vertices = std::move(mesh.vertices);
+            pending.data.indices = std::move(mesh.indices);
+            if (mesh.material >= 0)
+            {
+                // same maps and order as processMesh gets from Assimp's OBJ importer
+                const ObjMaterial &material = obj.materials[mesh.material];
+                vector<Texture> &textures = pending.data.textures;
+                if (!material.diffuseMap.empty())
+                    textures.push_back(loadTexture(material.diffuseMap.c_str(), "texture_diffuse"));
+                if (!material.specularMap.empty())
+                    textures.push_back(loadTexture(material.specularMap.c_str(), "texture_specular"));
+                if (!material.bumpMap.empty())
+                    textures.push_back(loadTexture(material.bumpMap.c_str(), "texture_normal"));
+                if (!material.ambientMap.empty())
+                    textures.push_back(loadTexture(material.ambientMap.c_str(), "texture_height"));
+                for (const Texture &texture : textures)
+                    pending.textureTickets.push_back(textureTickets[texture.path]);
+            }
+            converted.push_back(std::move(pending));
+        }
+        return true;
+    }
+
+    // reads a glTF model with the native loader, its primitives in parallel. Embedded images are decoded
+    // straight out of the mapped file, which stays open until the model is loaded.
+    bool importGltf(string const &path, vector<PendingMesh> &converted)
+    {
+        gltf.reset(new GltfModel());
+        // the native loader reads no skins, skinned models go through Assimp
+        if (!gltf->Open(path) || gltf->HasSkins())
+        {
+            gltf.reset();
+            return false;
+        }
+        vector<PendingMesh> primitives(gltf->PrimitiveCount());
+        atomic<bool> valid(true);
+        WaitGroup jobs;
+        jobs.Add(primitives.size());
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            const GltfModel *model = gltf.get();
+            MeshData *data = &primitives[i].data;
+            int material = gltf->Primitive(i).material;
+            bool tangents = !options.tangentsForNormalMapsOnly || (material >= 0 && gltf->Materials()[material].normalImage >= 0);
+            ThreadPool::Shared().Enqueue([model, i, data, tangents, &valid, &jobs]() {
+                if (!model->ReadPrimitive(i, data->vertices, data->indices, tangents))
+                    valid = false;
+                jobs.Done();
+            });
+        }
+        jobs.Wait();
+        if (!valid)
+        {
+            cout << "ERROR::GLTF:: " << path << ": invalid primitive" << endl;
+            gltf.reset();
+            return false;
+        }
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            PendingMesh &pending = primitives[i];
+            // glTF geometry is indexed already, the loader keeps it as it is
+            importedStats.sourceVertices += pending.data.vertices.size();
+            importedStats.sourceIndices += pending.data.indices.size();
+            int material = gltf->Primitive(i).material;
+            if (material >= 0)
+            {
+                const GltfMaterial &maps = gltf->Materials()[material];
+                vector<Texture> &textures = pending.data.textures;
+                if (maps.baseColorImage >= 0)
+                    textures.push_back(loadTexture(gltfImageName(maps.baseColorImage).c_str(), "texture_diffuse"));
+                if (maps.normalImage >= 0)
+                    textures.push_back(loadTexture(gltfImageName(maps.normalImage).c_str(), "texture_normal"));
+                for (const Texture &texture : textures)
+                    pending.textureTickets.push_back(textureTickets[texture.path]);
+            }
+            converted.push_back(std::move(pending));
+        }
+        return true;
+    }
+
+    // the uri of an external image, "*<index>" for one stored in the file
+    string gltfImageName(int image) const
+    {
+        const GltfImage &source = gltf->Images()[image];
+        return source.uri.empty() ? "*" + to_string(image) : source.uri;
+    }
+
+    // queues the meshes of a fresh cache file. Their geometry is uploaded directly from the mapped file.
+    bool loadFromCache(string const &cachePath, const MeshCacheKey &key)
+    {
+        if (!meshCache.Open(cachePath, key))
+            return false;
+        meshCache.GetBones(importedBones);
+        for (size_t i = 0; i < importedBones.size(); i++)
+            importedBoneIndex[importedBones[i].name] = static_cast<int>(i);
+        chooseVertexFormat(cachePath);
+
+        VertexCacheReport report;
+
+        for (unsigned int i = 0; i < meshCache.MeshCount() && !cancelImport; i++)
+        {
+            const MeshCacheMeshRecord &record = meshCache.MeshRecord(i);
+            PendingMesh mesh;
+            mesh.vertexData = meshCache.Vertices(i);
+            mesh.vertexCount = record.vertexCount;
+            mesh.indexData = meshCache.Indices(i);
+            mesh.indexCount = record.indexCount;
+            mesh.data.optimizeStats = meshCache.OptimizeStats(i);
+            meshCache.GetLods(i, mesh.data);
+            report.Add(mesh.data.optimizeStats, mesh.indexCount, mesh.vertexCount);
+            for (unsigned int t = 0; t < record.textureCount; t++)
+            {
+                const MeshCacheTextureRecord &texture = meshCache.TextureRecord(record.firstTexture + t);
+                string texturePath(texture.path, strnlen(texture.path, sizeof(texture.path)));
+                string textureType(texture.type, strnlen(texture.type, sizeof(texture.type)));
+                mesh.data.textures.push_back(loadTexture(texturePath.c_str(), textureType));
+            }
+            queueMesh(std::move(mesh));
+        }
+        report.Print(cachePath);
+        return true;
+    }
+
+    // runs the import time index/vertex buffer optimizations and LOD generation of all meshes in parallel on the thread pool.
+    void postProcessMeshes(vector<PendingMesh> &converted)
+    {
+        WaitGroup jobs;
+        jobs.Add(converted.size());
+        ModelLoadOptions settings = options;
+        for (PendingMesh &mesh : converted)
+        {
+            MeshData *data = &mesh.data;
+            ThreadPool::Shared().Enqueue([data, settings, &jobs]() {
+                if (settings.optimizeMeshes)
+                    OptimizeMesh(*data, settings.optimizeOverdraw, settings.overdrawThreshold);
+                ComputeMeshBounds(*data);
+                if (settings.generateLods)
+                    GenerateLods(*data, settings.lodLevels, settings.lodMaxError);
+                jobs.Done();
+            });
+        }
+        jobs.Wait();
+    }
+
+    // import side, once the bones are known and before any mesh is queued: packed vertices unless their bone ids
+    // can't address the whole skeleton
+    void chooseVertexFormat(string const &path)
+    {
+        vertexFormat = options.packedVertices ? PACKED_VERTEX : FULL_VERTEX;
+        if (vertexFormat == PACKED_VERTEX && importedBones.size() > MAX_PACKED_BONES)
+        {
+            cout << "WARNING::MODEL::IMPORT:: " << path << " has " << importedBones.size() << " bones, packed vertices address only "
+                << MAX_PACKED_BONES << ", uploading full vertices" << endl;
+            vertexFormat = FULL_VERTEX;
+        }
+    }
+
+    void queueMesh(PendingMesh &&mesh)
+    {
+        for (const Texture &texture : mesh.data.textures)
+            mesh.textureTickets.push_back(textureTickets[texture.path]);
+        lock_guard<mutex> lock(pendingMutex);
+        pendingMeshes.push_back(std::move(mesh));
+    }
+
+    // GL thread: uploads finished textures and up to maxMeshUploads meshes whose textures are all available.
+    bool uploadPending(unsigned int maxMeshUploads)
+    {
+        if (loaded)
+            return true;
+
+        size_t ticketCount = textureLoader->Count();
+        ticketIds.resize(ticketCount, 0);
+        bool texturesDone = true;
+        for (size_t t = 0; t < ticketCount; t++)
+        {
+            if (ticketIds[t] == 0 && textureLoader->IsReady(t))
+                ticketIds[t] = finishTexture(t);
+            texturesDone = texturesDone && ticketIds[t] != 0;
+        }
+
+        // read before looking at the queue: once the import is done nothing is added anymore
+        bool imported = importDone;
+        unsigned int uploads = 0;
+        bool meshesDone;
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            if (imported && options.sharedGeometry && !arenasReserved)
+                reserveArenas();
+            for (auto it = pendingMeshes.begin(); it != pendingMeshes.end() && uploads < maxMeshUploads; )
+            {
+                if (!texturesReady(*it))
+                {
+                    ++it;
+                    continue;
+                }
+                uploadMesh(*it);
+                it = pendingMeshes.erase(it);
+                uploads++;
+            }
+            meshesDone = pendingMeshes.empty();
+        }
+
+        if (imported && meshesDone && texturesDone && ticketCount == textureLoader->Count())
+        {
+            if (importThread.joinable())
+                importThread.join();
+            meshCache.Close();
+            textureLoader->PrintTimings();
+            textureLoader.reset();
+            gltf.reset();
+            textureTickets.clear();
+            ticketIds.clear();
+            bones = std::move(importedBones);
+            boneIndex = std::move(importedBoneIndex);
+            importStats = importedStats;
+            loaded = true;
+            restoring = false;
+            buildTextureArrays();
+            revision++;
+            if (options.evictable)
+                GpuResourceManager::Instance().Register(*this);
+        }
+        return loaded;
+    }
+
+    // GL thread: swaps in the meshes and textures of a finished reload. The previous ones go with the staging model.
+    void finishReload()
+    {
+        unique_ptr<Model> fresh = std::move(reloading);
+        // the import failed (or found nothing to draw)
+        if (fresh->meshes.empty())
+        {
+            cout << "ERROR::MODEL::RELOAD:: keeping the previous version of " << modelPath << endl;
+            return;
+        }
+        std::swap(meshes, fresh->meshes);
+        std::swap(textures_loaded, fresh->textures_loaded);
+        std::swap(textureIndex, fresh->textureIndex);
+        std::swap(bones, fresh->bones);
+        std::swap(boneIndex, fresh->boneIndex);
+        for (unsigned int index = 0; index < 3; index++)
+            std::swap(arenas[index], fresh->arenas[index]);
+        std::swap(materialArrays, fresh->materialArrays);
+        std::swap(textureLayers, fresh->textureLayers);
+        importStats = fresh->importStats;
+        revision++;
+        cout << "MODEL::RELOAD:: " << modelPath << ", " << meshes.size() << " meshes" << endl;
+    }
+
+    // drops the model's reference on a texture, the streamer forgets textures the registry deleted. Ids of textures
+    // packed into arrays are 0, they were released then.
+    static void releaseTexture(unsigned int id)
+    {
+        if (id != 0 && TextureRegistry::Instance().Release(id))
+            TextureStreamer::Instance().Remove(id);
+    }
+
+    bool texturesReady(const PendingMesh &mesh) const
+    {
+        for (size_t ticket : mesh.textureTickets)
+        {
+            if (ticket >= ticketIds.size() || ticketIds[ticket] == 0)
+                return false;
+        }
+        return true;
+    }
+
+    // registers (and if necessary uploads) one decoded texture and returns the id the model uses for it.
+    unsigned int finishTexture(size_t ticket)
+    {
+        TextureLoader::Entry &entry = textureLoader->GetEntry(ticket);
+        // found in the registry during the import, the reference is already taken
+        if (entry.resolved)
+            return entry.id;
+
+        TextureRegistry &registry = TextureRegistry::Instance();
+        string registryKey = TextureRegistry::NormalizePath(entry.filename);
+        if (options.shareTexturesByContent && entry.decoded)
+        {
+            unsigned int id = registry.AcquireByContent(registryKey, entry.contentHash);
+            if (id != 0)
+            {
+                textureLoader->Resolve(ticket, id);
+                return id;
+            }
+        }
+        if (options.streamTextures && entry.decoded && entry.levels.codec != CODEC_NONE)
+        {
+            // the streamer keeps the mip chain and uploads only the smallest levels for now
+            unsigned int streamed = TextureStreamer::Instance().Add(move(entry.levels));
+            textureLoader->Adopt(ticket, streamed);
+            unsigned int id = registry.Register(registryKey, streamed, entry.contentHash);
+            if (id != streamed)
+                TextureStreamer::Instance().Remove(streamed);
+            return id;
+        }
+        textureLoader->Upload(ticket);
+        return registry.Register(registryKey, entry.id, entry.contentHash);
+    }
+
+    void uploadMesh(PendingMesh &mesh)
+    {
+        for (size_t i = 0; i < mesh.data.textures.size(); i++)
+        {
+            Texture &texture = mesh.data.textures[i];
+            texture.id = ticketIds[mesh.textureTickets[i]];
+            if (textureIndex.find(texture.path) == textureIndex.end())
+            {
+                textureIndex[texture.path] = textures_loaded.size();
+                textures_loaded.push_back(texture);
+            }
+        }
+        Vertex_Format format = vertexFormat;
+        if (options.sharedGeometry)
+        {
+            GeometrySlice slice = arena(arenaIndex(mesh)).Add(mesh.Vertices(), mesh.VertexCount(), mesh.Indices(), mesh.IndexCount());
+            meshes.push_back(Mesh(slice, std::move(mesh.data.textures)));
+        }
+        else if (mesh.vertexData)
+            meshes.push_back(Mesh(mesh.vertexData, mesh.vertexCount, mesh.indexData, mesh.indexCount, std::move(mesh.data.textures), format, options.positionStream));
+        else
+            meshes.push_back(Mesh(std::move(mesh.data.vertices), std::move(mesh.data.indices), std::move(mesh.data.textures), format, options.positionStream));
+        meshes.back().lods = mesh.data.lods;
+        meshes.back().boundsCenter = mesh.data.boundsCenter;
+        meshes.back().boundsRadius = mesh.data.boundsRadius;
+        if (options.releaseCpuData)
+            meshes.back().ReleaseCpuData();
+    }
+
+    // arenas[0]: full vertices, [1]: packed vertices, [2]: packed vertices with the bone stream
+    unsigned int arenaIndex(const PendingMesh &mesh) const
+    {
+        if (vertexFormat == FULL_VERTEX)
+            return 0;
+        return HasBoneWeights(mesh.Vertices(), mesh.VertexCount()) ? 2 : 1;
+    }
+
+    GeometryArena& arena(unsigned int index)
+    {
+        if (!arenas[index])
+            arenas[index].reset(new GeometryArena(index == 0 ? FULL_VERTEX : PACKED_VERTEX, index == 2, options.positionStream));
+        return *arenas[index];
+    }
+
+    // once everything is imported, size the arenas for all remaining meshes so they're allocated only once.
+    void reserveArenas()
+    {
+        size_t vertexCounts[3] = {}, indexCounts[3] = {};
+        for (const PendingMesh &mesh : pendingMeshes)
+        {
+            unsigned int index = arenaIndex(mesh);
+            vertexCounts[index] += mesh.VertexCount();
+            indexCounts[index] += mesh.IndexCount();
+        }
+        for (unsigned int index = 0; index < 3; index++)
+        {
+            if (vertexCounts[index] > 0)
+                arena(index).Reserve(vertexCounts[index], indexCounts[index]);
+        }
+        arenasReserved = true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, vector<PendingMesh> &converted)
     {
         // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        for(unsigned int i = 0; i < node->mNumMeshes && !cancelImport; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            PendingMesh pending;
+            pending.data = processMesh(mesh, scene);
+            for (const Texture &texture : pending.data.textures)
+                pending.textureTickets.push_back(textureTickets[texture.path]);
+            converted.push_back(std::move(pending));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, converted);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Texture> &textures = data.textures;
 
         // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        ImportVertices(mesh, data.vertices);
+        // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        ImportIndices(mesh, data.indices);
+        // bone influences, the 4 largest per vertex
+        if (mesh->HasBones())
+            importBones(mesh, data.vertices);
 
-            vertices.push_back(vertex);
-        }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
-        }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -162,9 +1183,43 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+
+        // without aiProcess_CalcTangentSpace only meshes with a normal map get tangents, computed the same way
+        if (options.tangentsForNormalMapsOnly && !normalMaps.empty() && mesh->mTextureCoords[0])
+            GenerateTangents(data.vertices, data.indices);
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it's uploaded on the GL thread
+        return data;
+    }
+
+    // fills in the bone ids and weights of the mesh's vertices, keeping the MAX_BONE_INFLUENCE largest weights of each
+    // normalized, and adds its bones to the model's table. Meshes sharing a bone share its index.
+    void importBones(const aiMesh *mesh, vector<Vertex> &vertices)
+    {
+        for (unsigned int b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone *bone = mesh->mBones[b];
+            string name = bone->mName.C_Str();
+            auto found = importedBoneIndex.find(name);
+            int id;
+            if (found != importedBoneIndex.end())
+            {
+                id = found->second;
+            }
+            else
+            {
+                id = static_cast<int>(importedBones.size());
+                importedBoneIndex[name] = id;
+                importedBones.push_back({ name, ConvertMatrix(bone->mOffsetMatrix) });
+            }
+            for (unsigned int w = 0; w < bone->mNumWeights; w++)
+            {
+                const aiVertexWeight &weight = bone->mWeights[w];
+                if (weight.mVertexId < vertices.size())
+                    AddBoneInfluence(vertices[weight.mVertexId], id, weight.mWeight);
+            }
+        }
+        NormalizeBoneWeights(vertices);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -176,68 +1231,96 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // queues a single texture for loading unless this model referenced it before. Runs on the import side:
+    // the id is filled in on the GL thread once the texture is uploaded (or found in the registry).
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = path;
+        // check if texture was referenced before and if so, don't queue it again
+        if (textureTickets.find(texture.path) != textureTickets.end())
+            return texture;
+        if (path[0] == '*')
+        {
+            loadEmbeddedTexture(texture.path, typeName);
+        }
+        else
+        {
+            // another model may already have loaded it
+            unsigned int id = TextureRegistry::Instance().Acquire(TextureRegistry::NormalizePath(this->directory + '/' + path));
+            if (id != 0)
+                textureTickets[texture.path] = textureLoader->AddResolved(path, this->directory, id);
+            else
+                textureTickets[texture.path] = textureLoader->Add(path, this->directory,
+                    typeName == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR);
+        }
+        return texture;
+    }
+
+    // queues an image stored inside the glTF file. It's registered under the model's file name plus "*<index>",
+    // so embedded images of different models don't collide.
+    void loadEmbeddedTexture(const string &path, const string &typeName)
+    {
+        // a mesh cache hit doesn't open the model, its images still have to come from there
+        if (!gltf && HasGltfExtension(modelPath))
+        {
+            gltf.reset(new GltfModel());
+            if (!gltf->Open(modelPath))
+                gltf.reset();
+        }
+        string name = modelPath.substr(modelPath.find_last_of('/') + 1) + path;
+        unsigned int id = TextureRegistry::Instance().Acquire(TextureRegistry::NormalizePath(this->directory + '/' + name));
+        const GltfImage *image = gltf ? gltf->EmbeddedImage(path) : nullptr;
+        Texture_Usage usage = typeName == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR;
+        if (id != 0)
+            textureTickets[path] = textureLoader->AddResolved(name, this->directory, id);
+        else if (image)
+            textureTickets[path] = textureLoader->AddEncoded(name, this->directory, image->data, image->size, usage);
+        else
+            textureTickets[path] = textureLoader->Add(name, this->directory, usage);	// fails to decode, leaves an empty texture
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// loads an image into a mipmapped 2D texture, the mipmaps generated by glGenerateMipmap. Given cook settings it goes
+// through LoadOrCookTexture instead: compressed or CPU built mip chains (gamma aware if gamma is set), read from the
+// cooked files next to the image and written there only if cook->writeCooked is set.
+inline unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, const TextureCookSettings *cook)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    DecodedImage image;
+    TextureLevels levels;
     unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    bool decoded;
+    if (cook)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        TextureCookSettings settings = *cook;
+        settings.srgbMips = settings.srgbMips || gamma;
+        decoded = LoadOrCookTexture(filename, TEXTURE_USAGE_COLOR, settings, levels, image);
+    }
+    else
+    {
+        decoded = DecodeImageFile(filename, image);
+    }
+    if (decoded)
+    {
+        textureID = levels.codec != CODEC_NONE ? UploadTextureLevels2D(levels) : UploadTexture2D(image);
     }
     else
     {
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        glGenTextures(1, &textureID);
     }
+    FreeDecodedImage(image);
 
     return textureID;
 }
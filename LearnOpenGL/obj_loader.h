@@ -0,0 +1,749 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "asset_archive.h"
+#include "mesh.h"
+#include "thread_pool.h"
+using namespace std;
+
+// Native Wavefront OBJ/MTL loader, the fast path Model takes for .obj files instead of Assimp.
+//   1. the mapped file is split into chunks at line boundaries, and the chunks are parsed in parallel on the
+//      thread pool: positions, normals and texture coordinates with a small float parser, faces fan triangulated
+//   2. relative (negative) face indices are resolved once the counts before every chunk are known
+//   3. every (object, material) pair becomes one mesh, built in parallel: a hash table on the
+//      position/uv/normal triple deduplicates the face corners into Mesh's Vertex and index layout, and normals
+//      (where the file has none) and tangents are generated like aiProcess_GenSmoothNormals/CalcTangentSpace do
+// Assimp creates one vertex per face corner instead, so the vertex counts differ but the triangles are the same
+// (RunObjImportBenchmark compares the two). Files and material libraries are read through AssetFile, so the
+// loader works out of mounted archives as well.
+
+// texture maps of a material; paths as written in the .mtl, relative to the model's directory
+struct ObjMaterial {
+    string name;
+    string diffuseMap;	// map_Kd
+    string specularMap;	// map_Ks
+    string bumpMap;	// map_Bump, bump (Assimp's aiTextureType_HEIGHT)
+    string ambientMap;	// map_Ka
+};
+
+struct ObjMesh {
+    string object;
+    int material = -1;	// index into ObjModel::materials, -1 without usemtl
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+};
+
+struct ObjModel {
+    vector<ObjMaterial> materials;
+    vector<ObjMesh> meshes;
+};
+
+struct ObjLoadSettings {
+    // 1 - v, like aiProcess_FlipUVs
+    bool flipUVs = true;
+    bool tangents = true;
+    // tangents only for meshes whose material has a bump map, the one the shaders use as normal map
+    bool tangentsOnlyWithBumpMap = false;
+    // chunks smaller than this aren't worth a job of their own
+    size_t minChunkBytes = size_t(256) << 10;
+};
+
+// parses a decimal float ("-1.5", "2e-3", ".5") at p. Returns the end of the number or nullptr if there is none.
+// Up to 19 significant digits are accumulated in an integer and scaled once, exact for the usual 6-7 digit OBJ values.
+inline const char* ParseObjFloat(const char *p, const char *end, float &value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+                e = min(e * 10 + (*q - '0'), 10000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    double result = static_cast<double>(mantissa);
+    if (exponent >= 0)
+        result *= exponent <= 22 ? powers[exponent] : pow(10.0, exponent);
+    else
+        result /= exponent >= -22 ? powers[-exponent] : pow(10.0, -exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+namespace obj_detail
+{
+    // 0 based indices, -1 where a face corner has no texture coordinate or normal
+    struct Corner {
+        int32_t position;
+        int32_t texCoord;
+        int32_t normal;
+    };
+
+    // a corner that used relative indices: mask bit i says component i still lacks its chunk's offset
+    struct RelativeCorner {
+        size_t corner;
+        unsigned int mask;
+    };
+
+    enum StatementType { STATEMENT_MTLLIB, STATEMENT_USEMTL, STATEMENT_OBJECT };
+
+    // a statement that changes the state for the triangles from firstTriangle on
+    struct Statement {
+        StatementType type;
+        size_t firstTriangle;
+        string name;
+    };
+
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        vector<glm::vec3> positions;
+        vector<glm::vec3> normals;
+        vector<glm::vec2> texCoords;
+        vector<Corner> corners;	// 3 per triangle
+        vector<RelativeCorner> relative;
+        vector<Statement> statements;
+        size_t positionOffset = 0, normalOffset = 0, texCoordOffset = 0;
+        size_t errorLine = 0;	// line within the chunk, 1 based
+    };
+
+    struct TriangleRange {
+        const Chunk *chunk;
+        size_t first;
+        size_t count;
+    };
+
+    struct Group {
+        string object;
+        int material;
+        vector<TriangleRange> ranges;
+    };
+
+    inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char* skipSpace(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // the rest of the line without surrounding whitespace
+    inline string restOfLine(const char *p, const char *end)
+    {
+        p = skipSpace(p, end);
+        while (end > p && isSpace(end[-1]))
+            end--;
+        return string(p, end);
+    }
+
+    inline bool keyword(const char *p, const char *end, const char *word)
+    {
+        for (; *word; word++, p++)
+        {
+            if (p == end || *p != *word)
+                return false;
+        }
+        return p == end || isSpace(*p);
+    }
+
+    // parses up to count floats, returns how many there were
+    inline int parseFloats(const char *p, const char *end, float *values, int count)
+    {
+        int parsed = 0;
+        for (; parsed < count; parsed++)
+        {
+            p = skipSpace(p, end);
+            const char *next = ParseObjFloat(p, end, values[parsed]);
+            if (!next)
+                break;
+            p = next;
+        }
+        return parsed;
+    }
+
+    // one component of a face corner: 1 based, or negative for relative to the current count. 0 if absent.
+    inline const char* parseIndex(const char *p, const char *end, long &index)
+    {
+        bool negative = p < end && *p == '-';
+        if (negative)
+            p++;
+        long value = 0;
+        const char *start = p;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            value = min(value * 10 + (*p - '0'), 0x7fffffffL);
+        if (p == start)
+            return nullptr;
+        index = negative ? -value : value;
+        return p;
+    }
+
+    // resolves a 1 based or relative index against the chunk local count. Relative ones are marked in mask.
+    inline bool resolveIndex(long index, size_t count, unsigned int bit, int32_t &out, unsigned int &mask)
+    {
+        if (index > 0)
+        {
+            out = static_cast<int32_t>(index - 1);
+            return true;
+        }
+        if (index < 0)
+        {
+            // may still be negative here, the chunk's offset is added later
+            out = static_cast<int32_t>(static_cast<long>(count) + index);
+            mask |= bit;
+            return true;
+        }
+        return false;
+    }
+
+    inline bool parseFace(const char *p, const char *end, Chunk &chunk)
+    {
+        Corner polygon[64];
+        unsigned int masks[64];
+        int count = 0;
+        for (;;)
+        {
+            p = skipSpace(p, end);
+            if (p == end)
+                break;
+            if (count == 64)
+                return false;
+            Corner &corner = polygon[count];
+            unsigned int &mask = masks[count];
+            mask = 0;
+            corner.texCoord = corner.normal = -1;
+            long index;
+            p = parseIndex(p, end, index);
+            if (!p || !resolveIndex(index, chunk.positions.size(), 1, corner.position, mask))
+                return false;
+            if (p < end && *p == '/')
+            {
+                p++;
+                if (p < end && *p != '/')
+                {
+                    p = parseIndex(p, end, index);
+                    if (!p || !resolveIndex(index, chunk.texCoords.size(), 2, corner.texCoord, mask))
+                        return false;
+                }
+                if (p < end && *p == '/')
+                {
+                    p = parseIndex(p + 1, end, index);
+                    if (!p || !resolveIndex(index, chunk.normals.size(), 4, corner.normal, mask))
+                        return false;
+                }
+            }
+            if (p < end && !isSpace(*p))
+                return false;
+            count++;
+        }
+        if (count < 3)
+            return count > 0;	// points and degenerate faces are skipped
+        // fan around the first corner, which is what Assimp's triangulation does for convex polygons
+        for (int i = 1; i + 1 < count; i++)
+        {
+            const int fan[3] = { 0, i, i + 1 };
+            for (int k : fan)
+            {
+                if (masks[k])
+                    chunk.relative.push_back({ chunk.corners.size(), masks[k] });
+                chunk.corners.push_back(polygon[k]);
+            }
+        }
+        return true;
+    }
+
+    inline void parseChunk(Chunk &chunk)
+    {
+        const char *p = chunk.begin;
+        size_t line = 0;
+        while (p < chunk.end)
+        {
+            line++;
+            const char *lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+            if (!lineEnd)
+                lineEnd = chunk.end;
+            const char *s = skipSpace(p, lineEnd);
+            const char *next = lineEnd + (lineEnd < chunk.end ? 1 : 0);
+            if (s == lineEnd || *s == '#')
+            {
+                p = next;
+                continue;
+            }
+            bool ok = true;
+            if (s[0] == 'v' && s + 1 < lineEnd && isSpace(s[1]))
+            {
+                glm::vec3 position;
+                ok = parseFloats(s + 2, lineEnd, &position.x, 3) == 3;
+                chunk.positions.push_back(position);
+            }
+            else if (s[0] == 'v' && s + 2 < lineEnd && s[1] == 't' && isSpace(s[2]))
+            {
+                glm::vec2 texCoord(0.0f);
+                ok = parseFloats(s + 3, lineEnd, &texCoord.x, 2) >= 1;
+                chunk.texCoords.push_back(texCoord);
+            }
+            else if (s[0] == 'v' && s + 2 < lineEnd && s[1] == 'n' && isSpace(s[2]))
+            {
+                glm::vec3 normal;
+                ok = parseFloats(s + 3, lineEnd, &normal.x, 3) == 3;
+                chunk.normals.push_back(normal);
+            }
+            else if (s[0] == 'f' && s + 1 < lineEnd && isSpace(s[1]))
+            {
+                ok = parseFace(s + 2, lineEnd, chunk);
+            }
+            else if (keyword(s, lineEnd, "usemtl"))
+            {
+                chunk.statements.push_back({ STATEMENT_USEMTL, chunk.corners.size() / 3, restOfLine(s + 6, lineEnd) });
+            }
+            else if (keyword(s, lineEnd, "o") || keyword(s, lineEnd, "g"))
+            {
+                chunk.statements.push_back({ STATEMENT_OBJECT, chunk.corners.size() / 3, restOfLine(s + 1, lineEnd) });
+            }
+            else if (keyword(s, lineEnd, "mtllib"))
+            {
+                chunk.statements.push_back({ STATEMENT_MTLLIB, chunk.corners.size() / 3, restOfLine(s + 6, lineEnd) });
+            }
+            // s, l, p, curves and everything else are ignored
+            if (!ok)
+            {
+                chunk.errorLine = line;
+                return;
+            }
+            p = next;
+        }
+    }
+
+    // adds the counts before the chunk to its relative indices and checks all of them against the totals
+    inline bool resolveChunk(Chunk &chunk, size_t positions, size_t texCoords, size_t normals)
+    {
+        for (const RelativeCorner &relative : chunk.relative)
+        {
+            Corner &corner = chunk.corners[relative.corner];
+            if (relative.mask & 1)
+                corner.position += static_cast<int32_t>(chunk.positionOffset);
+            if (relative.mask & 2)
+                corner.texCoord += static_cast<int32_t>(chunk.texCoordOffset);
+            if (relative.mask & 4)
+                corner.normal += static_cast<int32_t>(chunk.normalOffset);
+        }
+        for (const Corner &corner : chunk.corners)
+        {
+            if (corner.position < 0 || static_cast<size_t>(corner.position) >= positions ||
+                corner.texCoord < -1 || (corner.texCoord >= 0 && static_cast<size_t>(corner.texCoord) >= texCoords) ||
+                corner.normal < -1 || (corner.normal >= 0 && static_cast<size_t>(corner.normal) >= normals))
+                return false;
+        }
+        return true;
+    }
+
+    // the value of a texture statement is its last token, after options like "-bm 0.5"
+    inline string textureName(const string &value)
+    {
+        size_t end = value.size();
+        while (end > 0 && isSpace(value[end - 1]))
+            end--;
+        size_t start = value.find_last_of(" \t", end == 0 ? 0 : end - 1);
+        start = start == string::npos ? 0 : start + 1;
+        return value.substr(start, end - start);
+    }
+
+    inline void parseMaterialLibrary(const string &path, vector<ObjMaterial> &materials)
+    {
+        AssetFile file;
+        if (!file.Open(path))
+        {
+            cout << "WARNING::OBJ:: can't read material library " << path << endl;
+            return;
+        }
+        const char *p = reinterpret_cast<const char*>(file.Data());
+        const char *end = p + file.Size();
+        ObjMaterial *material = nullptr;
+        while (p < end)
+        {
+            const char *lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char *s = skipSpace(p, lineEnd);
+            const char *word = s;
+            while (s < lineEnd && !isSpace(*s))
+                s++;
+            string key(word, s);
+            string value = restOfLine(s, lineEnd);
+            p = lineEnd + (lineEnd < end ? 1 : 0);
+            if (key == "newmtl")
+            {
+                materials.push_back(ObjMaterial());
+                material = &materials.back();
+                material->name = value;
+            }
+            else if (!material)
+            {
+                continue;
+            }
+            else if (key == "map_Kd")
+            {
+                material->diffuseMap = textureName(value);
+            }
+            else if (key == "map_Ks")
+            {
+                material->specularMap = textureName(value);
+            }
+            else if (key == "map_Bump" || key == "map_bump" || key == "bump")
+            {
+                material->bumpMap = textureName(value);
+            }
+            else if (key == "map_Ka")
+            {
+                material->ambientMap = textureName(value);
+            }
+        }
+    }
+
+    inline uint64_t hashCorner(const Corner &corner)
+    {
+        uint64_t hash = static_cast<uint32_t>(corner.position) * 0x9E3779B97F4A7C15ull;
+        hash ^= (static_cast<uint32_t>(corner.texCoord) + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+        hash ^= (static_cast<uint32_t>(corner.normal) + 0x165667B1ull) * 0x165667B19E3779F9ull;
+        return hash ^ (hash >> 29);
+    }
+
+    struct Attributes {
+        const vector<glm::vec3> *positions;
+        const vector<glm::vec2> *texCoords;
+        const vector<glm::vec3> *normals;
+    };
+
+    // deduplicates the group's corners into vertices and indices and fills in missing normals and the tangents.
+    inline void buildMesh(const Group &group, const Attributes &attributes, bool flipUVs, bool tangents, ObjMesh &mesh)
+    {
+        const vector<glm::vec3> &positions = *attributes.positions;
+        const vector<glm::vec2> &texCoords = *attributes.texCoords;
+        const vector<glm::vec3> &normals = *attributes.normals;
+        size_t cornerCount = 0;
+        for (const TriangleRange &range : group.ranges)
+            cornerCount += range.count * 3;
+
+        // open addressing table of vertex indices, at most half full
+        size_t capacity = 16;
+        while (capacity < cornerCount * 2)
+            capacity *= 2;
+        vector<uint32_t> table(capacity, UINT32_MAX);
+        vector<Corner> keys;
+        keys.reserve(cornerCount / 2);
+        mesh.vertices.reserve(cornerCount / 2);
+        mesh.indices.resize(cornerCount);
+        bool anyTexCoords = false, missingNormals = false;
+        size_t out = 0;
+        for (const TriangleRange &range : group.ranges)
+        {
+            const Corner *corners = range.chunk->corners.data() + range.first * 3;
+            for (size_t i = 0; i < range.count * 3; i++)
+            {
+                const Corner &corner = corners[i];
+                size_t slot = hashCorner(corner) & (capacity - 1);
+                for (;; slot = (slot + 1) & (capacity - 1))
+                {
+                    uint32_t index = table[slot];
+                    if (index == UINT32_MAX)
+                    {
+                        index = static_cast<uint32_t>(mesh.vertices.size());
+                        table[slot] = index;
+                        keys.push_back(corner);
+                        Vertex vertex;
+                        vertex.Position = positions[corner.position];
+                        vertex.TexCoords = glm::vec2(0.0f);
+                        if (corner.texCoord >= 0)
+                        {
+                            vertex.TexCoords = texCoords[corner.texCoord];
+                            if (flipUVs)
+                                vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+                            anyTexCoords = true;
+                        }
+                        vertex.Normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+                        missingNormals |= corner.normal < 0;
+                        vertex.Tangent = glm::vec3(0.0f);
+                        vertex.Bitangent = glm::vec3(0.0f);
+                        SetVertexBoneDataToDefault(vertex);
+                        mesh.vertices.push_back(vertex);
+                        mesh.indices[out++] = index;
+                        break;
+                    }
+                    const Corner &key = keys[index];
+                    if (key.position == corner.position && key.texCoord == corner.texCoord && key.normal == corner.normal)
+                    {
+                        mesh.indices[out++] = index;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // smooth normals: the face normals around each position averaged, for the corners the file gave none
+        if (missingNormals)
+        {
+            unordered_map<int32_t, glm::vec3> sums;
+            for (size_t i = 0; i < mesh.indices.size(); i += 3)
+            {
+                const Vertex &a = mesh.vertices[mesh.indices[i]];
+                const Vertex &b = mesh.vertices[mesh.indices[i + 1]];
+                const Vertex &c = mesh.vertices[mesh.indices[i + 2]];
+                glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+                float length = glm::length(normal);
+                if (length <= 0.0f)
+                    continue;
+                normal /= length;
+                for (int k = 0; k < 3; k++)
+                {
+                    const Corner &key = keys[mesh.indices[i + k]];
+                    if (key.normal < 0)
+                        sums[key.position] += normal;
+                }
+            }
+            for (size_t v = 0; v < mesh.vertices.size(); v++)
+            {
+                if (keys[v].normal >= 0)
+                    continue;
+                glm::vec3 sum = sums[keys[v].position];
+                float length = glm::length(sum);
+                mesh.vertices[v].Normal = length > 0.0f ? sum / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+        }
+
+        // computed from the flipped coordinates the shaders sample with
+        if (tangents && anyTexCoords)
+            GenerateTangents(mesh.vertices, mesh.indices);
+    }
+}
+
+inline bool HasObjExtension(const string &path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos || path.size() - dot != 4)
+        return false;
+    string extension = path.substr(dot + 1);
+    for (char &c : extension)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return extension == "obj";
+}
+
+// loads path into model. Returns false (and prints why) if the file can't be read or is malformed,
+// callers can then fall back to Assimp.
+inline bool LoadObj(const string &path, ObjModel &model, const ObjLoadSettings &settings = ObjLoadSettings())
+{
+    using namespace obj_detail;
+    model = ObjModel();
+    AssetFile file;
+    if (!file.Open(path))
+    {
+        cout << "ERROR::OBJ:: can't read " << path << endl;
+        return false;
+    }
+    const char *data = reinterpret_cast<const char*>(file.Data());
+    const char *end = data + file.Size();
+
+    // 1. chunks that end on line boundaries, parsed in parallel
+    ThreadPool &pool = ThreadPool::Shared();
+    size_t chunkCount = max<size_t>(1, min<size_t>(file.Size() / max<size_t>(settings.minChunkBytes, 1), pool.Size() * 4));
+    vector<Chunk> chunks(chunkCount);
+    const char *begin = data;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const char *split = i + 1 == chunkCount ? end : data + file.Size() / chunkCount * (i + 1);
+        if (split < begin)
+            split = begin;
+        const char *newline = split < end ? static_cast<const char*>(memchr(split, '\n', end - split)) : nullptr;
+        split = newline ? newline + 1 : end;
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+    WaitGroup jobs;
+    jobs.Add(chunks.size());
+    for (Chunk &chunk : chunks)
+    {
+        Chunk *target = &chunk;
+        pool.Enqueue([target, &jobs]() {
+            parseChunk(*target);
+            jobs.Done();
+        });
+    }
+    jobs.Wait();
+
+    // 2. global attribute arrays and absolute indices
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, lineOffset = 0;
+    for (Chunk &chunk : chunks)
+    {
+        if (chunk.errorLine)
+        {
+            cout << "ERROR::OBJ:: malformed line " << lineOffset + chunk.errorLine << " in " << path << endl;
+            return false;
+        }
+        lineOffset += count(chunk.begin, chunk.end, '\n');
+        chunk.positionOffset = positionCount;
+        chunk.texCoordOffset = texCoordCount;
+        chunk.normalOffset = normalCount;
+        positionCount += chunk.positions.size();
+        texCoordCount += chunk.texCoords.size();
+        normalCount += chunk.normals.size();
+    }
+    if (positionCount > INT32_MAX || texCoordCount > INT32_MAX || normalCount > INT32_MAX)
+        return false;
+    vector<glm::vec3> positions, normals;
+    vector<glm::vec2> texCoords;
+    positions.reserve(positionCount);
+    texCoords.reserve(texCoordCount);
+    normals.reserve(normalCount);
+    for (Chunk &chunk : chunks)
+    {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        vector<glm::vec3>().swap(chunk.positions);
+        vector<glm::vec2>().swap(chunk.texCoords);
+        vector<glm::vec3>().swap(chunk.normals);
+    }
+    atomic<bool> valid(true);
+    jobs.Add(chunks.size());
+    for (Chunk &chunk : chunks)
+    {
+        Chunk *target = &chunk;
+        pool.Enqueue([target, positionCount, texCoordCount, normalCount, &valid, &jobs]() {
+            if (!resolveChunk(*target, positionCount, texCoordCount, normalCount))
+                valid = false;
+            jobs.Done();
+        });
+    }
+    jobs.Wait();
+    if (!valid)
+    {
+        cout << "ERROR::OBJ:: face index out of range in " << path << endl;
+        return false;
+    }
+
+    // 3. materials, then the triangles sorted into (object, material) groups in order of first use
+    string directory = path.substr(0, path.find_last_of("/\\") == string::npos ? 0 : path.find_last_of("/\\") + 1);
+    for (const Chunk &chunk : chunks)
+    {
+        for (const Statement &statement : chunk.statements)
+        {
+            if (statement.type == STATEMENT_MTLLIB)
+                parseMaterialLibrary(directory + statement.name, model.materials);
+        }
+    }
+    map<string, int> materialIndices;
+    for (size_t i = 0; i < model.materials.size(); i++)
+        materialIndices.insert(make_pair(model.materials[i].name, static_cast<int>(i)));
+
+    vector<Group> groups;
+    map<pair<string, int>, size_t> groupIndices;
+    string object;
+    int material = -1;
+    for (const Chunk &chunk : chunks)
+    {
+        size_t triangles = chunk.corners.size() / 3;
+        size_t first = 0;
+        for (size_t s = 0; s <= chunk.statements.size(); s++)
+        {
+            size_t last = s < chunk.statements.size() ? chunk.statements[s].firstTriangle : triangles;
+            if (last > first)
+            {
+                auto found = groupIndices.find(make_pair(object, material));
+                if (found == groupIndices.end())
+                {
+                    found = groupIndices.insert(make_pair(make_pair(object, material), groups.size())).first;
+                    groups.push_back({ object, material, vector<TriangleRange>() });
+                }
+                groups[found->second].ranges.push_back({ &chunk, first, last - first });
+                first = last;
+            }
+            if (s == chunk.statements.size())
+                break;
+            const Statement &statement = chunk.statements[s];
+            if (statement.type == STATEMENT_OBJECT)
+            {
+                object = statement.name;
+            }
+            else if (statement.type == STATEMENT_USEMTL)
+            {
+                auto found = materialIndices.find(statement.name);
+                material = found != materialIndices.end() ? found->second : -1;
+            }
+        }
+    }
+
+    // 4. one mesh per group, built in parallel
+    Attributes attributes = { &positions, &texCoords, &normals };
+    model.meshes.resize(groups.size());
+    jobs.Add(groups.size());
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        const Group *group = &groups[i];
+        ObjMesh *mesh = &model.meshes[i];
+        mesh->object = group->object;
+        mesh->material = group->material;
+        bool flipUVs = settings.flipUVs;
+        bool tangents = settings.tangents && (!settings.tangentsOnlyWithBumpMap ||
+            (group->material >= 0 && !model.materials[group->material].bumpMap.empty()));
+        pool.Enqueue([group, mesh, &attributes, flipUVs, tangents, &jobs]() {
+            buildMesh(*group, attributes, flipUVs, tangents, *mesh);
+            jobs.Done();
+        });
+    }
+    jobs.Wait();
+    return true;
+}
+#endif
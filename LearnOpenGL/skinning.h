@@ -0,0 +1,172 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "gpu_resources.h"
+#include "mesh.h"
+#include "shader_s.h"
+using namespace std;
+
+// bone ids of packed vertices are 16 bit (PackedBoneData), larger skeletons need the full vertex format
+#define MAX_PACKED_BONES 65536
+
+// a bone of a skinned model: its index is what Vertex::m_BoneIDs refers to.
+struct BoneInfo {
+    string name;
+    // from mesh space to the bone's space in the bind pose (Assimp's aiBone::mOffsetMatrix)
+    glm::mat4 offset;
+};
+
+// adds one influence to a vertex, keeping the MAX_BONE_INFLUENCE largest weights. A bone listed twice adds up.
+inline void AddBoneInfluence(Vertex &vertex, int bone, float weight)
+{
+    if (weight <= 0.0f)
+        return;
+    int smallest = 0;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (vertex.m_BoneIDs[i] == bone)
+        {
+            vertex.m_Weights[i] += weight;
+            return;
+        }
+        if (vertex.m_BoneIDs[i] < 0)
+        {
+            vertex.m_BoneIDs[i] = bone;
+            vertex.m_Weights[i] = weight;
+            return;
+        }
+        if (vertex.m_Weights[i] < vertex.m_Weights[smallest])
+            smallest = i;
+    }
+    if (weight > vertex.m_Weights[smallest])
+    {
+        vertex.m_BoneIDs[smallest] = bone;
+        vertex.m_Weights[smallest] = weight;
+    }
+}
+
+// scales the kept weights of every skinned vertex to sum up to 1, so dropping influences doesn't shrink the mesh.
+inline void NormalizeBoneWeights(vector<Vertex> &vertices)
+{
+    for (Vertex &vertex : vertices)
+    {
+        float total = 0.0f;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            if (vertex.m_BoneIDs[i] >= 0)
+                total += vertex.m_Weights[i];
+        }
+        if (total <= 0.0f)
+            continue;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            if (vertex.m_BoneIDs[i] >= 0)
+                vertex.m_Weights[i] /= total;
+        }
+    }
+}
+
+// The bone matrices of every skinned instance drawn in a frame, uploaded in one go into a texture buffer that
+// skinning.vert / skinning_packed.vert read with texelFetch. A bone takes 3 RGBA32F texels, the rows of its
+// affine 3x4 matrix, so the palette isn't limited by the uniform space and switching instances only sets an int.
+//   palette.Begin();
+//   int base = palette.Add(finalBoneMatrices.data(), finalBoneMatrices.size());  // per instance: global * offset
+//   palette.Upload();
+//   palette.Bind(skinShader, 8);
+//   skinShader.setInt("boneBase", base);
+//   character.Draw(skinShader);
+// All member functions except Begin/Add must run on the GL context thread.
+class BonePalette
+{
+public:
+    BonePalette() {}
+    ~BonePalette()
+    {
+        if (texture != 0)
+            glDeleteTextures(1, &texture);
+        if (buffer != 0)
+        {
+            GpuResourceManager::Instance().BufferDeleted(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    BonePalette(const BonePalette&) = delete;
+    BonePalette& operator=(const BonePalette&) = delete;
+
+    // forgets the previous frame's instances
+    void Begin()
+    {
+        rows.clear();
+    }
+
+    // appends the final matrices of one instance (bone global transform * BoneInfo::offset) and returns the
+    // index of its first bone, the shader's boneBase.
+    int Add(const glm::mat4 *matrices, size_t count)
+    {
+        int base = static_cast<int>(rows.size() / 3);
+        rows.reserve(rows.size() + count * 3);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::mat4 rowMajor = glm::transpose(matrices[i]);
+            rows.push_back(rowMajor[0]);
+            rows.push_back(rowMajor[1]);
+            rows.push_back(rowMajor[2]);
+        }
+        return base;
+    }
+
+    // the bind pose: count identity matrices
+    int AddBindPose(size_t count)
+    {
+        vector<glm::mat4> identity(count, glm::mat4(1.0f));
+        return Add(identity.data(), count);
+    }
+
+    // replaces the buffer's contents with everything added since Begin(). Respecifying the whole store lets the
+    // driver hand out fresh memory instead of waiting for draws of the previous frame that still read the old one.
+    void Upload()
+    {
+        if (buffer == 0)
+        {
+            glGenBuffers(1, &buffer);
+            glGenTextures(1, &texture);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, rows.size() * sizeof(glm::vec4), rows.empty() ? NULL : rows.data(), GL_STREAM_DRAW);
+        GpuResourceManager::Instance().BufferAllocated(buffer, rows.size() * sizeof(glm::vec4));
+        if (!attached)
+        {
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            attached = true;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // binds the palette to a texture unit the meshes' own textures don't use and points the shader's bonePalette at it.
+    void Bind(Shader &shader, unsigned int unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("bonePalette", static_cast<int>(unit));
+    }
+
+    size_t BoneCount() const { return rows.size() / 3; }
+
+private:
+    vector<glm::vec4> rows;
+    unsigned int buffer = 0;
+    unsigned int texture = 0;
+    bool attached = false;
+};
+#endif
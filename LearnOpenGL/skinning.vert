@@ -0,0 +1,54 @@
+#version 410 core
+// lighting.vert for skinned meshes, blends up to 4 bones per vertex (see skinning.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// bone matrices of every instance drawn this frame, 3 texels (the rows of an affine matrix) per bone
+uniform samplerBuffer bonePalette;
+// first bone of this instance in the palette
+uniform int boneBase;
+
+mat4 boneMatrix(int bone)
+{
+    int texel = (boneBase + bone) * 3;
+    return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+        texelFetch(bonePalette, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat4 skinMatrix()
+{
+    // unused influences have a zero weight (and a bone id of -1 in the full vertex format)
+    mat4 skin = mat4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (aWeights[i] > 0.0)
+        {
+            skin += boneMatrix(aBoneIds[i]) * aWeights[i];
+            total += aWeights[i];
+        }
+    }
+    // meshes without bones stay where they are
+    return total > 0.0 ? skin / total : mat4(1.0);
+}
+
+void main()
+{
+    mat4 skin = skinMatrix();
+    vec4 position = model * skin * vec4(aPos, 1.0);
+    gl_Position = projection * view * position;
+    FragPos = vec3(position);
+    Normal = mat3(transpose(inverse(model))) * mat3(skin) * aNormal;
+    TexCoords = aTexCoords;
+}
@@ -0,0 +1,71 @@
+#version 410 core
+// lighting_packed.vert for skinned meshes uploaded with the PackedVertex layout and its bone stream (see skinning.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aNormalOct;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangentOct;
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+out mat3 TBN;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// bone matrices of every instance drawn this frame, 3 texels (the rows of an affine matrix) per bone
+uniform samplerBuffer bonePalette;
+// first bone of this instance in the palette
+uniform int boneBase;
+
+// inverse of OctahedralEncode() in mesh.h
+vec3 octDecode(vec2 oct)
+{
+    vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+mat4 boneMatrix(int bone)
+{
+    int texel = (boneBase + bone) * 3;
+    return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+        texelFetch(bonePalette, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat4 skinMatrix()
+{
+    mat4 skin = mat4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (aWeights[i] > 0.0)
+        {
+            skin += boneMatrix(aBoneIds[i]) * aWeights[i];
+            total += aWeights[i];
+        }
+    }
+    // the 8 bit weights don't add up to exactly 1; meshes without bones stay where they are
+    return total > 0.0 ? skin / total : mat4(1.0);
+}
+
+void main()
+{
+    mat4 skin = skinMatrix();
+    vec3 normal = octDecode(aNormalOct);
+    // tangent frame for normal mapping: the bitangent is rebuilt from its stored sign
+    vec3 tangent = octDecode(aTangentOct.xy);
+    vec3 bitangent = cross(normal, tangent) * aTangentOct.w;
+    mat3 normalMatrix = mat3(transpose(inverse(model))) * mat3(skin);
+
+    vec4 position = model * skin * vec4(aPos, 1.0);
+    gl_Position = projection * view * position;
+    FragPos = vec3(position);
+    Normal = normalMatrix * normal;
+    TexCoords = aTexCoords;
+    TBN = mat3(normalize(normalMatrix * tangent), normalize(normalMatrix * bitangent), normalize(Normal));
+}
@@ -0,0 +1,341 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gpu_resources.h"
+#include "shader_s.h"
+#include "texture_loader.h"
+using namespace std;
+
+// array samplers lighting_array.frag declares (materialArrays[MAX_MATERIAL_ARRAYS])
+#define MAX_MATERIAL_ARRAYS 8
+
+// where a texture lives in a TextureArraySet: which of its arrays (-1 for none) and which layer of it.
+struct TextureLayer {
+    int array = -1;
+    int layer = 0;
+};
+
+// Copies of 2D textures packed into GL_TEXTURE_2D_ARRAYs, one array per size, internal format and mip count, so a
+// whole model's materials are bound once and a mesh only selects its layers (see lighting_array.frag):
+//   TextureArraySet arrays;
+//   vector<TextureLayer> placed;
+//   arrays.Build(textureIds, placed);         // placed[i]: the layer of textureIds[i], set as e.g. diffuseLayer
+//   arrays.Bind(shader);                      // once, instead of per mesh
+// Every resident level of a texture is read back and uploaded into its layer, which stalls until the texture is
+// on the GPU: build once everything has loaded, not every frame. (glCopyImageSubData would copy on the GPU, but it
+// is GL 4.3 and the loader only has 3.3 core.) The set doesn't keep the 2D textures, a caller drawing only from the
+// arrays can delete them after Build and hand reloaded images to Update instead.
+// Must run on the GL context thread.
+class TextureArraySet
+{
+public:
+    TextureArraySet() {}
+    ~TextureArraySet() { Clear(); }
+
+    TextureArraySet(const TextureArraySet&) = delete;
+    TextureArraySet& operator=(const TextureArraySet&) = delete;
+
+    TextureArraySet(TextureArraySet &&other) noexcept { *this = std::move(other); }
+    TextureArraySet& operator=(TextureArraySet &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        Clear();
+        arrays = std::move(other.arrays);
+        other.arrays.clear();
+        return *this;
+    }
+
+    // packs textures (duplicates are packed once) and sets placed[i] to the layer of textures[i]. Returns false, and
+    // packs nothing, if they need more than maxArrays arrays or one of them isn't a complete 2D texture.
+    bool Build(const vector<unsigned int> &textures, vector<TextureLayer> &placed, unsigned int maxArrays = MAX_MATERIAL_ARRAYS)
+    {
+        Clear();
+        placed.assign(textures.size(), TextureLayer());
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        maxLayers = max(maxLayers, 256);
+
+        // group by what an array's layers have to share
+        vector<Source> sources;
+        unordered_map<unsigned int, TextureLayer> layers;	// 2D texture -> where its copy goes
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            unsigned int texture = textures[i];
+            auto packed = layers.find(texture);
+            if (packed != layers.end())
+            {
+                placed[i] = packed->second;
+                continue;
+            }
+            if (texture == 0)
+                continue;
+            Source source;
+            source.texture = texture;
+            if (!describe(texture, source.shape))
+            {
+                cout << "ERROR::TEXTURE_ARRAY:: texture " << texture << " has no image to copy" << endl;
+                Clear();
+                placed.clear();
+                return false;
+            }
+            int array = -1;
+            for (size_t a = 0; a < arrays.size(); a++)
+            {
+                if (arrays[a].shape == source.shape && arrays[a].layers < maxLayers)
+                {
+                    array = static_cast<int>(a);
+                    break;
+                }
+            }
+            if (array < 0)
+            {
+                if (arrays.size() >= maxArrays)
+                {
+                    cout << "WARNING::TEXTURE_ARRAY:: " << textures.size() << " textures need more than " << maxArrays << " arrays" << endl;
+                    Clear();
+                    placed.clear();
+                    return false;
+                }
+                array = static_cast<int>(arrays.size());
+                arrays.push_back(Array());
+                arrays.back().shape = source.shape;
+            }
+            source.layer.array = array;
+            source.layer.layer = arrays[array].layers++;
+            layers[texture] = source.layer;
+            placed[i] = source.layer;
+            sources.push_back(source);
+        }
+
+        for (Array &array : arrays)
+            allocate(array);
+        vector<unsigned char> buffer;
+        for (const Source &source : sources)
+            copyLayer(source.texture, arrays[source.layer.array], source.layer.layer, buffer);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return true;
+    }
+
+    // writes a reloaded image with its mip chain (block compressed or RGBA8) into a layer. Returns false, and
+    // changes nothing, if it no longer fits the layer's array: another size, format or a shorter chain.
+    bool Update(TextureLayer layer, const TextureLevels &image)
+    {
+        if (layer.array < 0 || layer.array >= static_cast<int>(arrays.size()))
+            return false;
+        const Array &array = arrays[layer.array];
+        const Shape &shape = array.shape;
+        bool compressed = image.codec != CODEC_RGBA8;
+        if (image.codec == CODEC_NONE || image.width != shape.width || image.height != shape.height ||
+            static_cast<GLint>(image.mips.size()) < shape.levels || compressed != shape.compressed ||
+            (compressed && static_cast<GLint>(CodecInternalFormat(image.codec)) != shape.internalFormat))
+            return false;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        for (GLint level = 0; level < shape.levels; level++)
+        {
+            const TextureLevel &mip = image.mips[level];
+            if (compressed)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer.layer, mip.width, mip.height, 1, static_cast<GLenum>(shape.internalFormat),
+                    static_cast<GLsizei>(mip.size), image.data.data() + mip.offset);
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer.layer, mip.width, mip.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data.data() + mip.offset);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return true;
+    }
+
+    // writes reloaded plain pixels into a layer and generates its mips. Returns false, and changes nothing, if it no
+    // longer fits the layer's array (another size, or a compressed array).
+    bool Update(TextureLayer layer, const DecodedImage &image)
+    {
+        if (layer.array < 0 || layer.array >= static_cast<int>(arrays.size()))
+            return false;
+        const Array &array = arrays[layer.array];
+        const Shape &shape = array.shape;
+        if (!image.data || shape.compressed || image.width != shape.width || image.height != shape.height)
+            return false;
+        GLenum format = image.components == 1 ? GL_RED : image.components == 2 ? GL_RG : image.components == 3 ? GL_RGB : GL_RGBA;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer.layer, image.width, image.height, 1, format, GL_UNSIGNED_BYTE, image.data);
+        // rebuilds every layer's chain from its level 0. Plain images got theirs from glGenerateMipmap to begin
+        // with (CPU built chains arrive as TextureLevels), so the other layers come out the same.
+        if (shape.levels > 1)
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return true;
+    }
+
+    void Clear()
+    {
+        for (Array &array : arrays)
+        {
+            if (array.id != 0)
+            {
+                GpuResourceManager::Instance().TextureDeleted(array.id);
+                glDeleteTextures(1, &array.id);
+            }
+        }
+        arrays.clear();
+    }
+
+    // binds the arrays to units firstUnit, firstUnit + 1, ... and points the shader's materialArrays[i] at them
+    void Bind(Shader &shader, unsigned int firstUnit = 0) const
+    {
+        for (size_t a = 0; a < arrays.size(); a++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + static_cast<unsigned int>(a));
+            glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[a].id);
+            shader.setInt("materialArrays[" + to_string(a) + "]", static_cast<int>(firstUnit + a));
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t ArrayCount() const { return arrays.size(); }
+    size_t LayerCount() const
+    {
+        size_t count = 0;
+        for (const Array &array : arrays)
+            count += array.layers;
+        return count;
+    }
+    bool Empty() const { return arrays.empty(); }
+
+private:
+    // what the layers of one array have in common
+    struct Shape {
+        GLint width = 0;
+        GLint height = 0;
+        GLint internalFormat = 0;
+        GLint levels = 0;
+        bool compressed = false;
+        // bytes of a 4x4 block of compressed formats
+        GLint blockBytes = 0;
+        // level the 2D texture's chain starts at (GL_TEXTURE_BASE_LEVEL), not part of the comparison
+        GLint baseLevel = 0;
+
+        bool operator==(const Shape &other) const
+        {
+            return width == other.width && height == other.height && internalFormat == other.internalFormat &&
+                levels == other.levels && compressed == other.compressed;
+        }
+    };
+
+    struct Array {
+        unsigned int id = 0;
+        Shape shape;
+        int layers = 0;
+    };
+
+    struct Source {
+        unsigned int texture = 0;
+        Shape shape;
+        TextureLayer layer;
+    };
+
+    vector<Array> arrays;
+
+    // reads the size, format and resident levels of a 2D texture
+    static bool describe(unsigned int texture, Shape &shape)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        GLint maxLevel = 1000;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &shape.baseLevel);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, shape.baseLevel, GL_TEXTURE_WIDTH, &shape.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, shape.baseLevel, GL_TEXTURE_HEIGHT, &shape.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, shape.baseLevel, GL_TEXTURE_INTERNAL_FORMAT, &shape.internalFormat);
+        GLint compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, shape.baseLevel, GL_TEXTURE_COMPRESSED, &compressed);
+        shape.compressed = compressed == GL_TRUE;
+        if (shape.width <= 0 || shape.height <= 0)
+            return false;
+        if (shape.compressed)
+        {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, shape.baseLevel, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            shape.blockBytes = size / (((shape.width + 3) / 4) * ((shape.height + 3) / 4));
+        }
+        // levels past the base one that are specified, down to 1x1 or MAX_LEVEL
+        shape.levels = 1;
+        for (GLint level = shape.baseLevel + 1; level <= maxLevel && shape.levels < 16; level++)
+        {
+            GLint width = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            if (width <= 0)
+                break;
+            shape.levels++;
+        }
+        return true;
+    }
+
+    static void allocate(Array &array)
+    {
+        const Shape &shape = array.shape;
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        size_t bytes = 0;
+        for (GLint level = 0; level < shape.levels; level++)
+        {
+            GLsizei width = max(1, shape.width >> level), height = max(1, shape.height >> level);
+            if (shape.compressed)
+            {
+                GLsizei size = ((width + 3) / 4) * ((height + 3) / 4) * shape.blockBytes * array.layers;
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, static_cast<GLenum>(shape.internalFormat), width, height, array.layers, 0, size, NULL);
+                bytes += size;
+            }
+            else
+            {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, shape.internalFormat, width, height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                // counted as 4 bytes per texel, what the color formats the loaders upload take
+                bytes += size_t(width) * height * 4 * array.layers;
+            }
+        }
+        GpuResourceManager::Instance().TextureAllocated(array.id, bytes);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, shape.levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, shape.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // reads every level of a 2D texture back and writes it into one layer of array
+    static void copyLayer(unsigned int texture, Array &array, int layer, vector<unsigned char> &buffer)
+    {
+        const Shape &shape = array.shape;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        GLint base = 0;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &base);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        for (GLint level = 0; level < shape.levels; level++)
+        {
+            GLsizei width = max(1, shape.width >> level), height = max(1, shape.height >> level);
+            if (shape.compressed)
+            {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, base + level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                buffer.resize(size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, base + level, buffer.data());
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, static_cast<GLenum>(shape.internalFormat), size, buffer.data());
+            }
+            else
+            {
+                // RGBA rows are always 4 byte aligned; fewer channels convert on the way and back
+                buffer.resize(size_t(width) * height * 4);
+                glGetTexImage(GL_TEXTURE_2D, base + level, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,555 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mip_generator.h"
+using namespace std;
+
+// CPU encoders for the GPU block compression formats, used to cook textures into .dds files (see dds_file.h)
+// that are uploaded with glCompressedTexImage2D:
+//   BC1  RGB,  4 bpp   (DXT1)
+//   BC3  RGBA, 8 bpp   (DXT5: BC4 alpha + BC1 color)
+//   BC5  RG,   8 bpp   (two BC4 channels, for tangent space normal maps; z is rebuilt in the shader)
+//   BC7  RGBA, 8 bpp   (mode 6 only: one subset, 7777.1 endpoints and 4 bit indices)
+// The encoders aim for fast cooking with reasonable quality (principal axis endpoint fit), not for the
+// quality of an exhaustive offline encoder.
+
+enum Texture_Codec {
+    CODEC_NONE,
+    CODEC_BC1,
+    CODEC_BC3,
+    CODEC_BC5,
+    CODEC_BC7,
+    // not compressed: a plain RGBA8 mip chain, built on the CPU instead of with glGenerateMipmap
+    CODEC_RGBA8
+};
+
+// what a texture is sampled as, decides which codec fits
+enum Texture_Usage {
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_NORMAL
+};
+
+struct TextureLevel {
+    int width;
+    int height;
+    size_t offset;
+    size_t size;
+};
+
+// a texture in one of the formats above with its whole mip chain in one allocation, level 0 first.
+struct TextureLevels {
+    Texture_Codec codec = CODEC_NONE;
+    int width = 0;
+    int height = 0;
+    // the mips were filtered in linear light
+    bool srgbMips = false;
+    vector<TextureLevel> mips;
+    vector<unsigned char> data;
+};
+
+inline const char* CodecName(Texture_Codec codec)
+{
+    switch (codec)
+    {
+    case CODEC_BC1: return "BC1";
+    case CODEC_BC3: return "BC3";
+    case CODEC_BC5: return "BC5";
+    case CODEC_BC7: return "BC7";
+    case CODEC_RGBA8: return "RGBA8";
+    default: return "uncompressed";
+    }
+}
+
+inline size_t CompressedBlockBytes(Texture_Codec codec)
+{
+    return codec == CODEC_BC1 ? 8 : 16;
+}
+
+inline size_t TextureLevelSize(Texture_Codec codec, int width, int height)
+{
+    if (codec == CODEC_RGBA8)
+        return size_t(width) * size_t(height) * 4;
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * CompressedBlockBytes(codec);
+}
+
+// picks the codec for a texture. BC5 is core since GL 3.0, BC1/BC3 need EXT_texture_compression_s3tc and BC7
+// ARB_texture_compression_bptc. Returns CODEC_NONE if nothing suitable is supported.
+inline Texture_Codec ChooseCodec(Texture_Usage usage, bool hasAlpha, bool s3tcSupported, bool bptcSupported)
+{
+    if (usage == TEXTURE_USAGE_NORMAL)
+        return CODEC_BC5;
+    if (bptcSupported)
+        return CODEC_BC7;
+    if (s3tcSupported)
+        return hasAlpha ? CODEC_BC3 : CODEC_BC1;
+    return CODEC_NONE;
+}
+
+// expands 1-4 component 8 bit pixels to RGBA8. Grey images are replicated into RGB.
+inline vector<unsigned char> ExpandToRGBA8(const unsigned char *pixels, int width, int height, int components)
+{
+    size_t count = size_t(width) * size_t(height);
+    vector<unsigned char> rgba(count * 4);
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *src = pixels + i * components;
+        unsigned char *dst = &rgba[i * 4];
+        if (components >= 3)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+        else
+        {
+            dst[0] = dst[1] = dst[2] = src[0];
+        }
+        dst[3] = components == 4 ? src[3] : components == 2 ? src[1] : 255;
+    }
+    return rgba;
+}
+
+// true if any pixel of a 2 or 4 component image isn't fully opaque.
+inline bool ImageHasTransparency(const unsigned char *pixels, int width, int height, int components)
+{
+    if (components != 2 && components != 4)
+        return false;
+    size_t count = size_t(width) * size_t(height);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (pixels[i * components + components - 1] != 255)
+            return true;
+    }
+    return false;
+}
+
+// copies the 4x4 texels of block (bx, by) into block, clamping at the image edges.
+inline void FetchBlockRGBA8(const unsigned char *rgba, int width, int height, int bx, int by, unsigned char block[64])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = min(bx * 4 + x, width - 1);
+            memcpy(&block[(y * 4 + x) * 4], &rgba[(size_t(sy) * width + sx) * 4], 4);
+        }
+    }
+}
+
+// principal axis of the block's texels in the first channels components, by power iteration on the covariance.
+// Returns false for blocks of a single color.
+inline bool BlockPrincipalAxis(const unsigned char block[64], int channels, float mean[4], float axis[4])
+{
+    for (int c = 0; c < 4; c++)
+        mean[c] = axis[c] = 0.0f;
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += block[i * 4 + c];
+    for (int c = 0; c < channels; c++)
+        mean[c] /= 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float d[4];
+        for (int c = 0; c < channels; c++)
+            d[c] = block[i * 4 + c] - mean[c];
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += d[a] * d[b];
+    }
+
+    float v[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * v[b];
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++)
+            length += next[c] * next[c];
+        if (length < 1e-12f)
+            return false;
+        length = sqrt(length);
+        for (int c = 0; c < channels; c++)
+            v[c] = next[c] / length;
+    }
+    for (int c = 0; c < channels; c++)
+        axis[c] = v[c];
+    return true;
+}
+
+// end points of the block along its principal axis, inset a little to reduce the error of the outliers.
+inline void BlockEndpoints(const unsigned char block[64], int channels, float low[4], float high[4])
+{
+    float mean[4], axis[4];
+    if (!BlockPrincipalAxis(block, channels, mean, axis))
+    {
+        for (int c = 0; c < 4; c++)
+            low[c] = high[c] = mean[c];
+        return;
+    }
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (block[i * 4 + c] - mean[c]) * axis[c];
+        tMin = min(tMin, t);
+        tMax = max(tMax, t);
+    }
+    float inset = (tMax - tMin) / 16.0f;
+    tMin += inset;
+    tMax -= inset;
+    for (int c = 0; c < 4; c++)
+    {
+        low[c] = c < channels ? min(max(mean[c] + axis[c] * tMin, 0.0f), 255.0f) : 255.0f;
+        high[c] = c < channels ? min(max(mean[c] + axis[c] * tMax, 0.0f), 255.0f) : 255.0f;
+    }
+}
+
+inline uint16_t PackRGB565(const float color[3])
+{
+    int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackRGB565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+inline void EncodeBC1Block(const unsigned char block[64], unsigned char out[8])
+{
+    float low[4], high[4];
+    BlockEndpoints(block, 3, low, high);
+    uint16_t color0 = PackRGB565(high), color1 = PackRGB565(low);
+    // four color mode requires color0 > color1
+    if (color0 < color1)
+        swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        UnpackRGB565(color0, palette[0]);
+        UnpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int d = block[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+    out[0] = color0 & 0xff;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xff;
+    out[3] = color1 >> 8;
+    for (int b = 0; b < 4; b++)
+        out[4 + b] = (indices >> (b * 8)) & 0xff;
+}
+
+// one channel of the block in the 8 value interpolation mode.
+inline void EncodeBC4Block(const unsigned char block[64], int channel, unsigned char out[8])
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        low = min(low, int(block[i * 4 + channel]));
+        high = max(high, int(block[i * 4 + channel]));
+    }
+    out[0] = static_cast<unsigned char>(high);
+    out[1] = static_cast<unsigned char>(low);
+
+    uint64_t indices = 0;
+    if (high != low)
+    {
+        int palette[8];
+        palette[0] = high;
+        palette[1] = low;
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * high + i * low) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int value = block[i * 4 + channel];
+            int best = 0, bestError = 256;
+            for (int p = 0; p < 8; p++)
+            {
+                int error = abs(value - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= uint64_t(best) << (i * 3);
+        }
+    }
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = (indices >> (b * 8)) & 0xff;
+}
+
+inline void EncodeBC3Block(const unsigned char block[64], unsigned char out[16])
+{
+    EncodeBC4Block(block, 3, out);
+    EncodeBC1Block(block, out + 8);
+}
+
+inline void EncodeBC5Block(const unsigned char block[64], unsigned char out[16])
+{
+    EncodeBC4Block(block, 0, out);
+    EncodeBC4Block(block, 1, out + 8);
+}
+
+// writes bits least significant first, the way BC7 blocks are laid out.
+struct BlockBitWriter {
+    unsigned char *bytes;
+    int position = 0;
+
+    explicit BlockBitWriter(unsigned char *bytes) : bytes(bytes) {}
+
+    void Write(uint32_t value, int bits)
+    {
+        for (int b = 0; b < bits; b++, position++)
+        {
+            if (value & (1u << b))
+                bytes[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+        }
+    }
+};
+
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// quantizes both BC7 mode 6 end points to 7 bits per channel plus the p-bit that fits each one best.
+inline void QuantizeBC7Endpoints(const float endpoints[2][4], int quantized[2][4], int pbit[2], int expanded[2][4])
+{
+    for (int e = 0; e < 2; e++)
+    {
+        int bestError = INT32_MAX;
+        for (int p = 0; p < 2; p++)
+        {
+            int error = 0, q[4];
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = min(max(static_cast<int>((endpoints[e][c] - p) / 2.0f + 0.5f), 0), 127);
+                int d = ((q[c] << 1) | p) - static_cast<int>(endpoints[e][c] + 0.5f);
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit[e] = p;
+                for (int c = 0; c < 4; c++)
+                    quantized[e][c] = q[c];
+            }
+        }
+        for (int c = 0; c < 4; c++)
+            expanded[e][c] = (quantized[e][c] << 1) | pbit[e];
+    }
+}
+
+// picks the closest of the 16 interpolated colors for every texel, returns the summed squared error.
+inline int AssignBC7Indices(const unsigned char block[64], const int expanded[2][4], int indices[16])
+{
+    int palette[16][4];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * expanded[0][c] + BC7_WEIGHTS4[i] * expanded[1][c] + 32) >> 6;
+
+    int total = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = INT32_MAX;
+        for (int p = 0; p < 16; p++)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int d = block[i * 4 + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices[i] = best;
+        total += bestError;
+    }
+    return total;
+}
+
+// least squares end points for fixed indices. Returns false if all texels use the same weight.
+inline bool RefitBC7Endpoints(const unsigned char block[64], const int indices[16], float endpoints[2][4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float b = BC7_WEIGHTS4[indices[i]] / 64.0f, a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 4; c++)
+        {
+            ax[c] += a * block[i * 4 + c];
+            bx[c] += b * block[i * 4 + c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (fabs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints[0][c] = min(max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+        endpoints[1][c] = min(max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+// BC7 mode 6: RGBA end points with 7 bits per channel plus a shared low bit (p-bit) each, 16 interpolation steps.
+// The principal axis fit is refined by two rounds of least squares end point fitting.
+inline void EncodeBC7Block(const unsigned char block[64], unsigned char out[16])
+{
+    float endpoints[2][4];
+    BlockEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+    int quantized[2][4], pbit[2], expanded[2][4], indices[16];
+    QuantizeBC7Endpoints(endpoints, quantized, pbit, expanded);
+    int error = AssignBC7Indices(block, expanded, indices);
+    for (int iteration = 0; iteration < 2 && error > 0; iteration++)
+    {
+        int refitQuantized[2][4], refitPbit[2], refitExpanded[2][4], refitIndices[16];
+        if (!RefitBC7Endpoints(block, indices, endpoints))
+            break;
+        QuantizeBC7Endpoints(endpoints, refitQuantized, refitPbit, refitExpanded);
+        int refitError = AssignBC7Indices(block, refitExpanded, refitIndices);
+        if (refitError >= error)
+            break;
+        error = refitError;
+        memcpy(quantized, refitQuantized, sizeof(quantized));
+        memcpy(pbit, refitPbit, sizeof(pbit));
+        memcpy(indices, refitIndices, sizeof(indices));
+    }
+
+    // the first index is stored without its top bit, so it has to be < 8: swap the end points if it isn't
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 4; c++)
+            swap(quantized[0][c], quantized[1][c]);
+        swap(pbit[0], pbit[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    BlockBitWriter writer(out);
+    writer.Write(1u << 6, 7);	// mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        writer.Write(quantized[0][c], 7);
+        writer.Write(quantized[1][c], 7);
+    }
+    writer.Write(pbit[0], 1);
+    writer.Write(pbit[1], 1);
+    writer.Write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.Write(indices[i], 4);
+}
+
+// compresses one RGBA8 image level and appends the blocks to data.
+inline void CompressLevel(const unsigned char *rgba, int width, int height, Texture_Codec codec, vector<unsigned char> &data)
+{
+    if (codec == CODEC_RGBA8)
+    {
+        data.insert(data.end(), rgba, rgba + size_t(width) * size_t(height) * 4);
+        return;
+    }
+    size_t blockBytes = CompressedBlockBytes(codec);
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t start = data.size();
+    data.resize(start + size_t(blocksX) * blocksY * blockBytes);
+    unsigned char *out = &data[start];
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++, out += blockBytes)
+        {
+            FetchBlockRGBA8(rgba, width, height, bx, by, block);
+            switch (codec)
+            {
+            case CODEC_BC1: EncodeBC1Block(block, out); break;
+            case CODEC_BC3: EncodeBC3Block(block, out); break;
+            case CODEC_BC5: EncodeBC5Block(block, out); break;
+            case CODEC_BC7: EncodeBC7Block(block, out); break;
+            default: break;
+            }
+        }
+    }
+}
+
+// compresses decoded pixels (1-4 components) and, if mipmaps is set, its whole box filtered mip chain down to 1x1.
+// srgbMips filters the color channels in linear light (see DownsampleSRGBA8). CODEC_RGBA8 only builds the chain.
+inline bool CompressImage(const unsigned char *pixels, int width, int height, int components, Texture_Codec codec,
+    TextureLevels &image, bool srgbMips = false, bool mipmaps = true)
+{
+    if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4 || codec == CODEC_NONE)
+        return false;
+
+    image.codec = codec;
+    image.width = width;
+    image.height = height;
+    image.srgbMips = srgbMips;
+    image.mips.clear();
+    image.data.clear();
+
+    vector<unsigned char> level = ExpandToRGBA8(pixels, width, height, components), next;
+    int levelWidth = width, levelHeight = height;
+    for (;;)
+    {
+        TextureLevel mip;
+        mip.width = levelWidth;
+        mip.height = levelHeight;
+        mip.offset = image.data.size();
+        CompressLevel(level.data(), levelWidth, levelHeight, codec, image.data);
+        mip.size = image.data.size() - mip.offset;
+        image.mips.push_back(mip);
+        if (!mipmaps || (levelWidth == 1 && levelHeight == 1))
+            break;
+        DownsampleMip(level, levelWidth, levelHeight, srgbMips, next, levelWidth, levelHeight);
+        level.swap(next);
+    }
+    return true;
+}
+#endif
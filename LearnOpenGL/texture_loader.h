@@ -0,0 +1,491 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include "asset_archive.h"
+#include "dds_file.h"
+#include "file_utils.h"
+#include "gpu_resources.h"
+#include "image_decoder.h"
+#include "texture_compress.h"
+#include "thread_pool.h"
+using namespace std;
+
+// block compression formats that aren't part of the GL 3.3 core headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2            0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM     0x8E8C
+#endif
+
+// decodes an encoded image (PNG, JPEG, ...) that is already in memory, e.g. embedded in a .glb file, with the
+// decoder ImageDecoders picks for its format. optionally hashes the encoded bytes. Safe to call from any thread.
+inline bool DecodeImageMemory(const unsigned char *data, size_t size, DecodedImage &image, uint64_t *contentHash = nullptr)
+{
+    if (contentHash)
+        *contentHash = HashBytes(data, size);
+    return ImageDecoders::Instance().Decode(data, size, image);
+}
+
+// decodes an image file straight out of a memory mapping of the file (or of the archive it's in).
+// optionally hashes the encoded file content. Safe to call from any thread.
+inline bool DecodeImageFile(const string &filename, DecodedImage &image, uint64_t *contentHash = nullptr)
+{
+    AssetFile file;
+    if (!file.Open(filename))
+        return false;
+    return DecodeImageMemory(file.Data(), file.Size(), image, contentHash);
+}
+
+// creates a mipmapped, repeating 2D texture from decoded pixels. Must run on the GL context thread.
+// Given a textureID, respecifies that texture instead, e.g. to reload it in place.
+inline unsigned int UploadTexture2D(const DecodedImage &image, unsigned int textureID = 0)
+{
+    if (textureID == 0)
+        glGenTextures(1, &textureID);
+
+    GLenum format = GL_RGB;
+    if (image.components == 1)
+        format = GL_RED;
+    else if (image.components == 3)
+        format = GL_RGB;
+    else if (image.components == 4)
+        format = GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    // the defaults, but a reused texture may have been streamed or uploaded with a shorter cooked chain
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    // drivers store RGB with 4 bytes per texel
+    GpuResourceManager::Instance().TextureAllocated(textureID, TextureBytes2D(image.width, image.height, image.components == 3 ? 4 : image.components, true));
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+// which block compression formats the driver can sample. BC5 (RGTC) is core in GL 3.0 and always available.
+struct TextureCompressionSupport {
+    bool s3tc = false;	// BC1, BC3
+    bool bptc = false;	// BC7
+};
+
+// queries the extension list of the current context. Must run on the GL context thread.
+inline TextureCompressionSupport QueryTextureCompressionSupport()
+{
+    TextureCompressionSupport support;
+    GLint major = 0, minor = 0, count = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    support.bptc = major > 4 || (major == 4 && minor >= 2);
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (!name)
+            continue;
+        if (strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            support.s3tc = true;
+        else if (strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+            support.bptc = true;
+    }
+    return support;
+}
+
+inline bool IsCodecSupported(Texture_Codec codec, const TextureCompressionSupport &support)
+{
+    switch (codec)
+    {
+    case CODEC_BC1:
+    case CODEC_BC3: return support.s3tc;
+    case CODEC_BC5: return true;
+    case CODEC_BC7: return support.bptc;
+    default: return false;
+    }
+}
+
+inline GLenum CodecInternalFormat(Texture_Codec codec)
+{
+    switch (codec)
+    {
+    case CODEC_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case CODEC_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case CODEC_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case CODEC_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+// creates a repeating 2D texture from a block compressed or RGBA8 image and its precomputed mip chain, no decoding
+// or mipmap generation happens on the GPU side. Must run on the GL context thread.
+// Given a textureID, respecifies that texture instead, e.g. to reload it in place.
+inline unsigned int UploadTextureLevels2D(const TextureLevels &image, unsigned int textureID = 0)
+{
+    if (textureID == 0)
+        glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    size_t bytes = 0;
+    for (size_t level = 0; level < image.mips.size(); level++)
+    {
+        const TextureLevel &mip = image.mips[level];
+        bytes += mip.size;
+        if (image.codec == CODEC_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                image.data.data() + mip.offset);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), CodecInternalFormat(image.codec), mip.width, mip.height, 0,
+                static_cast<GLsizei>(mip.size), image.data.data() + mip.offset);
+    }
+    // a cooked chain may stop before 1x1, don't let the sampler read levels that don't exist
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.mips.size()) - 1);
+    GpuResourceManager::Instance().TextureAllocated(textureID, bytes);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.mips.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+// the cooked versions of an image file live next to it: the block compressed one and the plain RGBA8 mip chain
+inline string CookedTexturePath(const string &filename)
+{
+    return filename + ".dds";
+}
+
+inline string MipChainPath(const string &filename)
+{
+    return filename + ".mips.dds";
+}
+
+// what the texture workers do with an image besides decoding it.
+struct TextureCookSettings {
+    // block compress in the best format support allows (see ChooseCodec)
+    bool compress = false;
+    TextureCompressionSupport support;
+    // build the mip chain on the CPU, as RGBA8 for textures that aren't compressed
+    bool cpuMipmaps = false;
+    // filter the mips of color textures in linear light, for gamma encoded images
+    bool srgbMips = false;
+    // store what was cooked next to the source for the next run. Opt in, it adds files beside the images
+    bool writeCooked = false;
+    // use a cooked file next to the source if its stamp matches. Off for reloads: stamps only resolve whole seconds
+    bool readCooked = true;
+};
+
+// compresses decoded pixels or builds their mip chain as settings ask, and frees the pixels on success.
+// Returns false, leaving image untouched, when there is nothing to cook.
+inline bool CookDecodedImage(DecodedImage &image, Texture_Usage usage, const TextureCookSettings &settings, TextureLevels &levels)
+{
+    Texture_Codec codec = CODEC_NONE;
+    if (settings.compress)
+    {
+        bool hasAlpha = ImageHasTransparency(image.data, image.width, image.height, image.components);
+        codec = ChooseCodec(usage, hasAlpha, settings.support.s3tc, settings.support.bptc);
+    }
+    if (codec == CODEC_NONE && settings.cpuMipmaps)
+        codec = CODEC_RGBA8;
+    bool srgbMips = settings.srgbMips && usage == TEXTURE_USAGE_COLOR;
+    if (codec == CODEC_NONE || !CompressImage(image.data, image.width, image.height, image.components, codec, levels, srgbMips))
+        return false;
+    FreeDecodedImage(image);
+    return true;
+}
+
+// loads the cooked version of an image file if it's up to date and usable with settings; otherwise decodes the
+// source, compresses it or builds its mip chain and (if settings.writeCooked) stores the result for the next run.
+// Leaves the decoded pixels in image when there is nothing to cook. Safe to call from any thread.
+// cookedFromSource reports whether the encoder/mip generator ran.
+inline bool LoadOrCookTexture(const string &filename, Texture_Usage usage, const TextureCookSettings &settings,
+    TextureLevels &levels, DecodedImage &image, uint64_t *contentHash = nullptr, bool *cookedFromSource = nullptr)
+{
+    if (cookedFromSource)
+        *cookedFromSource = false;
+    bool srgbMips = settings.srgbMips && usage == TEXTURE_USAGE_COLOR;
+    FileStamp source;
+    bool hasStamp = GetAssetStamp(filename, source);
+    if (hasStamp && settings.readCooked)
+    {
+        bool found = settings.compress && ReadDDS(CookedTexturePath(filename), levels, &source) &&
+            levels.codec != CODEC_RGBA8 && IsCodecSupported(levels.codec, settings.support);
+        if (!found && settings.cpuMipmaps)
+            found = ReadDDS(MipChainPath(filename), levels, &source) && levels.codec == CODEC_RGBA8;
+        if (found && levels.srgbMips == srgbMips)
+        {
+            if (contentHash)
+            {
+                AssetFile file;
+                if (file.Open(filename))
+                    *contentHash = HashBytes(file.Data(), file.Size());
+            }
+            return true;
+        }
+    }
+    levels = TextureLevels();
+
+    if (!DecodeImageFile(filename, image, contentHash))
+        return false;
+    if (!CookDecodedImage(image, usage, settings, levels))
+        return true;
+    if (cookedFromSource)
+        *cookedFromSource = true;
+    if (settings.writeCooked && hasStamp)
+        WriteDDS(levels.codec == CODEC_RGBA8 ? MipChainPath(filename) : CookedTexturePath(filename), levels, source);
+    return true;
+}
+
+// Staged texture loader: images are decoded in parallel on a worker pool as soon as they are added,
+// only the GL uploads run on the context thread.
+//   TextureLoader loader;
+//   size_t ticket = loader.Add("diffuse.png", directory);   // any thread, starts decoding
+//   loader.Upload();                                         // GL thread, waits for the decodes
+//   unsigned int id = loader.TextureId(ticket);
+// SetCookSettings() makes the workers load (or cook) block compressed versions or CPU built mip chains instead,
+// see LoadOrCookTexture.
+// Entries are never moved once added, so references returned by GetEntry() stay valid.
+class TextureLoader
+{
+public:
+    struct Entry {
+        string path;
+        string filename;
+        Texture_Usage usage = TEXTURE_USAGE_COLOR;
+        DecodedImage image;
+        // filled instead of image when the texture was cooked (block compressed or a CPU built mip chain)
+        TextureLevels levels;
+        bool cooked = false;
+        unsigned int id = 0;
+        uint64_t contentHash = 0;
+        bool decoded = false;
+        bool uploaded = false;
+        // the id was provided through AddResolved()/Resolve() instead of being uploaded by this loader
+        bool resolved = false;
+        // set by the worker once decoding finished (successfully or not)
+        atomic<bool> ready;
+        double decodeMs = 0.0;
+        double uploadMs = 0.0;
+
+        Entry() : ready(false) {}
+    };
+
+    // hashContent: also hash each file's encoded bytes, so identical images under different paths can be shared.
+    explicit TextureLoader(bool hashContent = false, ThreadPool &pool = ThreadPool::Shared()) : hashContent(hashContent), pool(pool) {}
+    ~TextureLoader()
+    {
+        Wait();
+        for (Entry &entry : entries)
+            FreeDecodedImage(entry.image);
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // applies to images added from now on: compress them or build their mip chains in the workers, using
+    // cooked .dds files next to the sources and cooking missing or stale ones.
+    void SetCookSettings(const TextureCookSettings &settings)
+    {
+        cookSettings = settings;
+    }
+
+    // queues an image for decoding and returns the ticket to look up its texture id later. Thread safe.
+    // usage picks the compression format and mip filter when cooking.
+    size_t Add(const string &path, const string &directory, Texture_Usage usage = TEXTURE_USAGE_COLOR)
+    {
+        return add(path, directory, usage, nullptr, 0);
+    }
+
+    // queues an encoded image that is already in memory (e.g. embedded in a .glb). data must stay valid until
+    // the entry is ready. It's cooked like a file but nothing is read from or written next to the path. Thread safe.
+    size_t AddEncoded(const string &path, const string &directory, const unsigned char *data, size_t size, Texture_Usage usage = TEXTURE_USAGE_COLOR)
+    {
+        return add(path, directory, usage, data, size);
+    }
+
+    // adds an entry for a texture that already exists on the GPU, nothing gets decoded or uploaded. Thread safe.
+    size_t AddResolved(const string &path, const string &directory, unsigned int id)
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        entries.emplace_back();
+        Entry &entry = entries.back();
+        entry.path = path;
+        entry.filename = directory.empty() ? path : directory + '/' + path;
+        entry.id = id;
+        entry.uploaded = true;
+        entry.resolved = true;
+        entry.ready = true;
+        return entries.size() - 1;
+    }
+
+    size_t Count() const
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        return entries.size();
+    }
+
+    Entry& GetEntry(size_t ticket)
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        return entries[ticket];
+    }
+
+    bool IsReady(size_t ticket) { return GetEntry(ticket).ready; }
+    unsigned int TextureId(size_t ticket) { return GetEntry(ticket).id; }
+
+    // blocks until every image added so far is decoded.
+    void Wait() { decodes.Wait(); }
+
+    // supplies an existing texture for a decoded entry, so it's never uploaded and its pixels are dropped.
+    void Resolve(size_t ticket, unsigned int id)
+    {
+        Entry &entry = GetEntry(ticket);
+        entry.id = id;
+        entry.uploaded = true;
+        entry.resolved = true;
+        FreeDecodedImage(entry.image);
+        entry.levels = TextureLevels();
+    }
+
+    // records a texture that was created from the entry's data somewhere else (e.g. by the TextureStreamer, which
+    // took the mip chain) and frees what is left of the CPU copy.
+    void Adopt(size_t ticket, unsigned int id)
+    {
+        Entry &entry = GetEntry(ticket);
+        entry.id = id;
+        entry.uploaded = true;
+        FreeDecodedImage(entry.image);
+        entry.levels.data = vector<unsigned char>();
+    }
+
+    // uploads one decoded image and frees its pixels. Must run on the GL context thread and only once IsReady().
+    // images that failed to decode still get a (empty) texture object so ids are always valid.
+    void Upload(size_t ticket)
+    {
+        Entry &entry = GetEntry(ticket);
+        if (entry.uploaded)
+            return;
+        auto start = chrono::steady_clock::now();
+        if (entry.decoded && entry.levels.codec != CODEC_NONE)
+        {
+            entry.id = UploadTextureLevels2D(entry.levels);
+        }
+        else if (entry.decoded)
+        {
+            entry.id = UploadTexture2D(entry.image);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << entry.filename << std::endl;
+            glGenTextures(1, &entry.id);
+        }
+        entry.uploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        entry.uploaded = true;
+        FreeDecodedImage(entry.image);
+        entry.levels.data = vector<unsigned char>();
+    }
+
+    // waits for all decodes and uploads everything. Must run on the GL context thread.
+    void Upload()
+    {
+        Wait();
+        for (size_t i = 0; i < Count(); i++)
+            Upload(i);
+    }
+
+    void PrintTimings()
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        double decodeTotal = 0.0, uploadTotal = 0.0;
+        for (const Entry &entry : entries)
+        {
+            if (entry.resolved)
+            {
+                std::cout << "TEXTURE::LOAD:: " << entry.filename << " shared with an already loaded texture" << std::endl;
+                continue;
+            }
+            if (entry.levels.codec != CODEC_NONE)
+                std::cout << "TEXTURE::LOAD:: " << entry.filename << " (" << entry.levels.width << "x" << entry.levels.height
+                    << " " << CodecName(entry.levels.codec) << ", " << entry.levels.mips.size() << " levels) "
+                    << (entry.cooked ? "cooked " : "read ") << entry.decodeMs << " ms, upload " << entry.uploadMs << " ms" << std::endl;
+            else
+                std::cout << "TEXTURE::LOAD:: " << entry.filename << " (" << entry.image.width << "x" << entry.image.height
+                    << "x" << entry.image.components << ") decode " << entry.decodeMs << " ms, upload " << entry.uploadMs << " ms" << std::endl;
+            decodeTotal += entry.decodeMs;
+            uploadTotal += entry.uploadMs;
+        }
+        if (!entries.empty())
+            std::cout << "TEXTURE::LOAD:: " << entries.size() << " textures, decode " << decodeTotal << " ms (summed over workers), upload " << uploadTotal << " ms" << std::endl;
+    }
+
+private:
+    size_t add(const string &path, const string &directory, Texture_Usage usage, const unsigned char *data, size_t size)
+    {
+        Entry *entry;
+        size_t ticket;
+        {
+            lock_guard<mutex> lock(entriesMutex);
+            entries.emplace_back();
+            entry = &entries.back();
+            ticket = entries.size() - 1;
+        }
+        entry->path = path;
+        entry->filename = directory.empty() ? path : directory + '/' + path;
+        entry->usage = usage;
+
+        decodes.Add();
+        bool hash = hashContent;
+        TextureCookSettings cook = cookSettings;
+        pool.Enqueue([this, entry, hash, cook, data, size]() {
+            auto start = chrono::steady_clock::now();
+            uint64_t *contentHash = hash ? &entry->contentHash : nullptr;
+            if (data)
+            {
+                entry->decoded = DecodeImageMemory(data, size, entry->image, contentHash);
+                if (entry->decoded && (cook.compress || cook.cpuMipmaps))
+                    entry->cooked = CookDecodedImage(entry->image, entry->usage, cook, entry->levels);
+            }
+            else if (cook.compress || cook.cpuMipmaps)
+            {
+                entry->decoded = LoadOrCookTexture(entry->filename, entry->usage, cook, entry->levels, entry->image, contentHash, &entry->cooked);
+            }
+            else
+            {
+                entry->decoded = DecodeImageFile(entry->filename, entry->image, contentHash);
+            }
+            entry->decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            entry->ready = true;
+            decodes.Done();
+        });
+        return ticket;
+    }
+
+    bool hashContent;
+    TextureCookSettings cookSettings;
+    ThreadPool &pool;
+    deque<Entry> entries;
+    mutable mutex entriesMutex;
+    WaitGroup decodes;
+};
+#endif
@@ -0,0 +1,139 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_utils.h"
+#include "gpu_resources.h"
+using namespace std;
+
+// Process wide registry of GL textures, so models referencing the same image share one texture object.
+// Textures are keyed by a hash of their normalized path and, optionally, of their file content.
+// Every Acquire/Register has to be paired with a Release; the GL texture is deleted with the last Release.
+class TextureRegistry
+{
+public:
+    static TextureRegistry& Instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // turns "dir\\sub/../a.png" and "dir/./a.png" into "dir/a.png" so both map to the same key.
+    static string NormalizePath(const string &path)
+    {
+        return ::NormalizePath(path);
+    }
+
+    // returns the texture registered under the path and takes a reference on it, or 0 if there is none.
+    unsigned int Acquire(const string &normalizedPath)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto found = byPath.find(HashString(normalizedPath));
+        if (found == byPath.end())
+            return 0;
+        entries[found->second].refs++;
+        return found->second;
+    }
+
+    // returns the texture registered under the path without taking a reference, or 0 if there is none.
+    unsigned int Find(const string &normalizedPath) const
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto found = byPath.find(HashString(normalizedPath));
+        return found != byPath.end() ? found->second : 0;
+    }
+
+    // returns a texture with identical file content and takes a reference on it, or 0 if there is none.
+    // the path is remembered as an alias so later lookups by path hit directly.
+    unsigned int AcquireByContent(const string &normalizedPath, uint64_t contentHash)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto found = byContent.find(contentHash);
+        if (found == byContent.end())
+            return 0;
+        Entry &entry = entries[found->second];
+        entry.refs++;
+        addPath(found->second, entry, normalizedPath);
+        return found->second;
+    }
+
+    // registers a freshly uploaded texture with one reference. If another thread registered the same path
+    // in the meantime, the new texture is deleted and the existing one is returned (and referenced) instead.
+    unsigned int Register(const string &normalizedPath, unsigned int id, uint64_t contentHash = 0)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto found = byPath.find(HashString(normalizedPath));
+        if (found != byPath.end())
+        {
+            if (found->second != id)
+            {
+                GpuResourceManager::Instance().TextureDeleted(id);
+                glDeleteTextures(1, &id);
+            }
+            entries[found->second].refs++;
+            return found->second;
+        }
+        Entry &entry = entries[id];
+        entry.refs++;
+        addPath(id, entry, normalizedPath);
+        if (contentHash != 0 && byContent.find(contentHash) == byContent.end())
+        {
+            entry.contentHash = contentHash;
+            byContent[contentHash] = id;
+        }
+        return id;
+    }
+
+    // drops one reference and frees the GPU memory once nobody uses the texture anymore.
+    // returns true if the texture was deleted.
+    bool Release(unsigned int id)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto found = entries.find(id);
+        if (found == entries.end() || --found->second.refs > 0)
+            return false;
+        for (uint64_t pathHash : found->second.pathHashes)
+            byPath.erase(pathHash);
+        if (found->second.contentHash != 0)
+            byContent.erase(found->second.contentHash);
+        entries.erase(found);
+        GpuResourceManager::Instance().TextureDeleted(id);
+        glDeleteTextures(1, &id);
+        return true;
+    }
+
+    size_t Count() const
+    {
+        lock_guard<mutex> lock(registryMutex);
+        return entries.size();
+    }
+
+private:
+    struct Entry {
+        unsigned int refs = 0;
+        uint64_t contentHash = 0;
+        vector<uint64_t> pathHashes;
+    };
+
+    mutable mutex registryMutex;
+    unordered_map<unsigned int, Entry> entries;
+    unordered_map<uint64_t, unsigned int> byPath;
+    unordered_map<uint64_t, unsigned int> byContent;
+
+    TextureRegistry() {}
+
+    void addPath(unsigned int id, Entry &entry, const string &normalizedPath)
+    {
+        uint64_t pathHash = HashString(normalizedPath);
+        if (byPath.emplace(pathHash, id).second)
+            entry.pathHashes.push_back(pathHash);
+    }
+};
+#endif
@@ -0,0 +1,269 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "gpu_resources.h"
+#include "texture_compress.h"
+#include "texture_loader.h"
+using namespace std;
+
+// Mip level streaming for textures with a CPU side mip chain (cooked or built by the decode workers).
+// A texture starts out with only its smallest levels on the GPU; GL_TEXTURE_BASE_LEVEL hides the missing larger
+// ones. Every frame the renderer reports how many pixels each texture covers on screen (Request), and Update()
+// makes the levels that are worth it resident, within a budget of GPU memory: when the wanted levels don't fit,
+// the textures with the fewest screen pixels per texel give up their top levels first. Dropped levels are
+// respecified with size 0 so the driver can release their memory, and re-uploaded from the CPU copy when they
+// are needed again.
+//   TextureStreamer &streamer = TextureStreamer::Instance();
+//   unsigned int id = streamer.Add(move(levels));      // instead of uploading the whole chain
+//   streamer.Request(id, projectedPixels);             // while drawing, for every texture a mesh uses
+//   streamer.Update();                                 // once per frame
+// All member functions must run on the GL context thread.
+class TextureStreamer
+{
+public:
+    struct Settings {
+        // GPU memory all streamed textures may use together
+        size_t budgetBytes = size_t(256) << 20;
+        // levels uploaded right away, counted from the smallest one (6 -> up to 32x32)
+        unsigned int initialLevels = 6;
+        // upload limit per Update(), so raising residency is spread over frames. At least one level always goes
+        size_t uploadBytesPerUpdate = size_t(8) << 20;
+        // added to the level computed from the screen size; negative values keep sharper levels, e.g. for tiling
+        float lodBias = 0.0f;
+    };
+
+    static TextureStreamer& Instance()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    Settings settings;
+
+    // creates the texture with only its smallest levels resident and keeps the chain for streaming.
+    unsigned int Add(TextureLevels &&levels)
+    {
+        unsigned int id;
+        glGenTextures(1, &id);
+        start(id, entries[id], move(levels));
+        return id;
+    }
+
+    // swaps the chain of a streamed texture for a new one, e.g. after its file changed. The texture keeps its id and,
+    // as after Add, starts over with only the smallest levels resident. Returns false if id isn't streamed.
+    bool Replace(unsigned int id, TextureLevels &&levels)
+    {
+        auto found = entries.find(id);
+        if (found == entries.end())
+            return false;
+        residentBytes -= found->second.residentBytes;
+        found->second = Entry();
+        start(id, found->second, move(levels));
+        return true;
+    }
+
+    // forgets a texture, e.g. once the TextureRegistry deleted it. Does not touch the GL object.
+    void Remove(unsigned int id)
+    {
+        auto found = entries.find(id);
+        if (found == entries.end())
+            return;
+        residentBytes -= found->second.residentBytes;
+        entries.erase(found);
+    }
+
+    bool IsStreamed(unsigned int id) const { return entries.find(id) != entries.end(); }
+
+    // reports that texture id covers about projectedPixels pixels across on screen this frame.
+    void Request(unsigned int id, float projectedPixels)
+    {
+        auto found = entries.find(id);
+        if (found != entries.end())
+            found->second.requestedPixels = max(found->second.requestedPixels, projectedPixels);
+    }
+
+    // brings the resident levels in line with this frame's requests and the budget, then clears the requests.
+    void Update()
+    {
+        struct Candidate {
+            float priority;
+            Entry *entry;
+            bool operator<(const Candidate &other) const { return priority > other.priority; }
+        };
+
+        // the level each texture would like; textures nobody asked for keep what they have
+        size_t wantedBytes = 0;
+        priority_queue<Candidate> droppable;	// lowest screen pixels per texel first
+        for (auto &item : entries)
+        {
+            Entry &entry = item.second;
+            int count = static_cast<int>(entry.levels.mips.size());
+            if (entry.requestedPixels > 0.0f)
+            {
+                float largest = static_cast<float>(max(entry.levels.width, entry.levels.height));
+                float level = log2(largest / entry.requestedPixels) + settings.lodBias;
+                entry.wanted = min(max(static_cast<int>(floor(level)), 0), entry.lowestBase);
+            }
+            else
+            {
+                entry.wanted = min(entry.base, entry.lowestBase);
+            }
+            entry.wanted = min(entry.wanted, count - 1);
+            wantedBytes += bytesFrom(entry, entry.wanted);
+            if (entry.wanted < entry.lowestBase)
+                droppable.push({ pixelsPerTexel(entry), &entry });
+        }
+        while (wantedBytes > settings.budgetBytes && !droppable.empty())
+        {
+            Entry &entry = *droppable.top().entry;
+            droppable.pop();
+            wantedBytes -= entry.levels.mips[entry.wanted].size;
+            entry.wanted++;
+            if (entry.wanted < entry.lowestBase)
+                droppable.push({ pixelsPerTexel(entry), &entry });
+        }
+
+        // evictions first, so the uploads below fit into the freed memory
+        vector<pair<float, unsigned int> > raises;
+        for (auto &item : entries)
+        {
+            Entry &entry = item.second;
+            if (entry.wanted > entry.base)
+            {
+                glBindTexture(GL_TEXTURE_2D, item.first);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.wanted);
+                for (int level = entry.base; level < entry.wanted; level++)
+                    releaseLevel(entry, level);
+                entry.base = entry.wanted;
+                GpuResourceManager::Instance().TextureAllocated(item.first, entry.residentBytes);
+            }
+            else if (entry.wanted < entry.base)
+            {
+                raises.push_back(make_pair(pixelsPerTexel(entry), item.first));
+            }
+            entry.requestedPixels = 0.0f;
+        }
+
+        // raise the most magnified textures first, one level at a time within the upload limit
+        sort(raises.begin(), raises.end(), [](const pair<float, unsigned int> &a, const pair<float, unsigned int> &b) { return a.first > b.first; });
+        size_t uploaded = 0;
+        for (const pair<float, unsigned int> &raise : raises)
+        {
+            Entry &entry = entries[raise.second];
+            glBindTexture(GL_TEXTURE_2D, raise.second);
+            while (entry.base > entry.wanted)
+            {
+                size_t size = entry.levels.mips[entry.base - 1].size;
+                if (uploaded > 0 && uploaded + size > settings.uploadBytesPerUpdate)
+                    break;
+                uploadLevel(entry, entry.base - 1);
+                entry.base--;
+                uploaded += size;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.base);
+            GpuResourceManager::Instance().TextureAllocated(raise.second, entry.residentBytes);
+            if (uploaded >= settings.uploadBytesPerUpdate)
+                break;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    size_t Count() const { return entries.size(); }
+    size_t ResidentBytes() const { return residentBytes; }
+
+    void PrintStats() const
+    {
+        size_t fullBytes = 0;
+        for (const auto &item : entries)
+            fullBytes += item.second.levels.data.size();
+        std::cout << "TEXTURE::STREAM:: " << entries.size() << " textures, " << residentBytes / 1024 << " KB resident of "
+            << fullBytes / 1024 << " KB, budget " << settings.budgetBytes / 1024 << " KB" << std::endl;
+    }
+
+private:
+    struct Entry {
+        TextureLevels levels;
+        // first resident level; levels.mips.size() while nothing is uploaded yet
+        int base = 0;
+        // the smallest levels from here on always stay resident
+        int lowestBase = 0;
+        int wanted = 0;
+        float requestedPixels = 0.0f;
+        size_t residentBytes = 0;
+    };
+
+    unordered_map<unsigned int, Entry> entries;
+    size_t residentBytes = 0;
+
+    TextureStreamer() {}
+
+    static size_t bytesFrom(const Entry &entry, int level)
+    {
+        size_t bytes = 0;
+        for (size_t i = static_cast<size_t>(level); i < entry.levels.mips.size(); i++)
+            bytes += entry.levels.mips[i].size;
+        return bytes;
+    }
+
+    // how magnified the wanted level would be on screen, 0 for textures that weren't requested
+    static float pixelsPerTexel(const Entry &entry)
+    {
+        const TextureLevel &mip = entry.levels.mips[entry.wanted];
+        return entry.requestedPixels / static_cast<float>(max(mip.width, mip.height));
+    }
+
+    void start(unsigned int id, Entry &entry, TextureLevels &&levels)
+    {
+        entry.levels = move(levels);
+        int count = static_cast<int>(entry.levels.mips.size());
+        entry.lowestBase = max(0, count - static_cast<int>(max(settings.initialLevels, 1u)));
+
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        for (int level = count - 1; level >= entry.lowestBase; level--)
+            uploadLevel(entry, level);
+        entry.base = entry.lowestBase;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.base);
+        GpuResourceManager::Instance().TextureAllocated(id, entry.residentBytes);
+    }
+
+    // expects the texture to be bound
+    void uploadLevel(Entry &entry, int level)
+    {
+        const TextureLevel &mip = entry.levels.mips[level];
+        const unsigned char *data = entry.levels.data.data() + mip.offset;
+        if (entry.levels.codec == CODEC_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, CodecInternalFormat(entry.levels.codec), mip.width, mip.height, 0,
+                static_cast<GLsizei>(mip.size), data);
+        entry.residentBytes += mip.size;
+        residentBytes += mip.size;
+    }
+
+    // expects the texture to be bound and the level to be below GL_TEXTURE_BASE_LEVEL
+    void releaseLevel(Entry &entry, int level)
+    {
+        if (entry.levels.codec == CODEC_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, CodecInternalFormat(entry.levels.codec), 0, 0, 0, 0, NULL);
+        size_t size = entry.levels.mips[level].size;
+        entry.residentBytes -= size;
+        residentBytes -= size;
+    }
+};
+#endif
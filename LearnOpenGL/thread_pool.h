@@ -0,0 +1,114 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the outstanding jobs of one batch, so a caller can wait for its own work
+// without waiting for everything else that was queued on the same pool.
+class WaitGroup
+{
+public:
+    void Add(size_t count = 1)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding += count;
+    }
+
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--outstanding == 0)
+            finished.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return outstanding == 0; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t outstanding = 0;
+};
+
+// A fixed set of worker threads that run queued jobs in FIFO order.
+// Jobs must not touch the OpenGL context: only the thread that owns the context may do that.
+class ThreadPool
+{
+public:
+    // 0 threads means one per hardware thread, keeping one core free for the render thread.
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threadCount = hardware > 1 ? hardware - 1 : 1;
+        }
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // the process wide pool shared by all loaders.
+    static ThreadPool& Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    unsigned int Size() const { return static_cast<unsigned int>(workers.size()); }
+
+    void Enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+#endif